@@ -0,0 +1,108 @@
+/**
+ * @file BackendComparison.cxx
+ * @brief Compare the Clone and Vary systematics backends for increasing
+ * numbers of systematics.
+ *
+ * The input is an in-memory RDataFrame, so no input data is read. Half of the
+ * systematics vary the momentum, which is cut on, and half vary the weight.
+ * For each backend and number of systematics the time taken to book the
+ * analysis and to run the event loop are reported.
+ *
+ * Usage: BackendComparison [entries]
+ */
+
+#include "RDFAnalysis/Node.h"
+#include "RDFAnalysis/EmptyDetail.h"
+#include "RDFAnalysis/DefaultBranchNamer.h"
+#include "RDFAnalysis/SystematicsBackend.h"
+
+#include <ROOT/RDataFrame.hxx>
+#include <TH1.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+  using ms_t = std::chrono::duration<double, std::milli>;
+
+  /// The time taken by each stage of one configuration
+  struct Timing {
+    /// Creating the nodes and booking the results
+    double book;
+    /// Running the event loop and retrieving every variation
+    double run;
+  };
+
+  /// Book and run a small analysis with nSyst systematics
+  Timing runAnalysis(
+      ULong64_t nEntries,
+      std::size_t nSyst,
+      RDFAnalysis::SystematicsBackend backend)
+  {
+    auto start = Clock::now();
+    std::vector<std::string> systematics{"NOSYS"};
+    ROOT::RDF::RNode input = ROOT::RDataFrame(nEntries)
+      .Define("NOSYS_pt", [] (ULong64_t entry) { return 10. + entry % 100; }, {"rdfentry_"})
+      .Define("NOSYS_weight", [] (ULong64_t entry) { return 1. + (entry % 7) / 10.; }, {"rdfentry_"});
+    for (std::size_t idx = 0; idx < nSyst; ++idx) {
+      std::string syst = "SYS" + std::to_string(idx);
+      double scale = 1. + (idx + 1) / 100.;
+      systematics.push_back(syst);
+      input = input.Define(
+          syst + (idx % 2 == 0 ? "_pt" : "_weight"),
+          [scale] (double value) { return scale * value; },
+          {idx % 2 == 0 ? "NOSYS_pt" : "NOSYS_weight"});
+    }
+    auto root = RDFAnalysis::Node<RDFAnalysis::EmptyDetail>::createROOT(
+        input,
+        std::make_unique<RDFAnalysis::DefaultBranchNamer>(systematics),
+        true, "ROOT", "Number of events", "", RDFAnalysis::WeightStrategy::Default,
+        backend);
+    root->Define("ptGeV", [] (double pt) { return pt / 1000.; }, {"pt"});
+    auto all = root->Fill<double>(TH1D("ptAll", "", 50, 0, 0.2), {"ptGeV"}, "weight");
+    auto selected = root->Filter([] (double pt) { return pt > 0.05; }, {"ptGeV"}, "ptCut");
+    auto pass = selected->Fill<double>(TH1D("ptPass", "", 50, 0, 0.2), {"ptGeV"}, "weight");
+    auto booked = Clock::now();
+    // Retrieving every variation makes sure that all of them are evaluated
+    double sum = 0;
+    for (auto* result : {&all, &pass})
+      for (auto& resultPair : *result)
+        sum += resultPair.second.get()->GetSumOfWeights();
+    if (sum <= 0)
+      throw std::runtime_error("Nothing was filled!");
+    auto end = Clock::now();
+    return {ms_t(booked - start).count(), ms_t(end - booked).count()};
+  }
+} //> end anonymous namespace
+
+int main(int argc, char* argv[])
+{
+  ULong64_t nEntries = argc > 1 ? std::stoull(argv[1]) : 1000000;
+  std::vector<std::pair<std::string, RDFAnalysis::SystematicsBackend>> backends{
+    {"Clone", RDFAnalysis::SystematicsBackend::Clone}};
+#ifdef RDFAnalysis_HAS_VARY
+  backends.emplace_back("Vary", RDFAnalysis::SystematicsBackend::Vary);
+#else
+  std::cout << "The Vary backend needs ROOT 6.26 or newer, only Clone is timed"
+            << std::endl;
+#endif
+  std::cout << std::setw(10) << "backend"
+            << std::setw(8) << "systs"
+            << std::setw(12) << "book [ms]"
+            << std::setw(12) << "run [ms]" << std::endl;
+  for (std::size_t nSyst : {0, 2, 10, 50, 100}) {
+    for (const auto& backendPair : backends) {
+      Timing timing = runAnalysis(nEntries, nSyst, backendPair.second);
+      std::cout << std::setw(10) << backendPair.first
+                << std::setw(8) << nSyst
+                << std::setw(12) << std::fixed << std::setprecision(1) << timing.book
+                << std::setw(12) << timing.run << std::endl;
+    }
+  }
+  return 0;
+}
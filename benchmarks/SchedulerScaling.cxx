@@ -0,0 +1,161 @@
+/**
+ * @file SchedulerScaling.cxx
+ * @brief Measure how the time taken to build a schedule scales with the size
+ * of the analysis.
+ *
+ * Synthetic analyses are registered directly on a SchedulerBase, so no input
+ * data is read. Each region applies a fixed number of filters drawn from a
+ * shared pool. The size of the pool is set by the sharing factor, the average
+ * number of regions that use each filter, so a higher sharing factor gives the
+ * scheduler more common prefixes to merge.
+ *
+ * Usage: SchedulerScaling [repeats]
+ */
+
+#include "RDFAnalysis/SchedulerBase.h"
+#include "RDFAnalysis/DefaultBranchNamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+  /// Exposes the protected parts of SchedulerBase needed here
+  class BenchmarkScheduler : public RDFAnalysis::SchedulerBase {
+    public:
+      using SchedulerBase::addAction;
+      using SchedulerBase::schedule;
+  };
+
+  /// The shape of a synthetic analysis
+  struct Config {
+    /// The number of regions
+    std::size_t nRegions;
+    /// The number of filters applied by each region
+    std::size_t depth;
+    /// The average number of regions using each filter
+    std::size_t sharing;
+    /// The number of variables
+    std::size_t nVariables;
+    /// The number of fills in each region
+    std::size_t nFills;
+  };
+
+  /// The number of input columns
+  constexpr std::size_t nInputs = 10;
+
+  /// Register a synthetic analysis and return the number of actions
+  std::size_t buildAnalysis(
+      BenchmarkScheduler& scheduler,
+      const Config& config,
+      std::mt19937& rng)
+  {
+    using Action = RDFAnalysis::SchedulerBase::Action;
+    auto random = [&rng] (std::size_t n) { return rng() % n; };
+    auto variable = [] (std::size_t idx) { return "var" + std::to_string(idx); };
+    std::size_t nActions = 0;
+    // Each variable reads an input column and up to two earlier variables
+    for (std::size_t idx = 0; idx < config.nVariables; ++idx) {
+      std::set<Action> dependencies{
+        {RDFAnalysis::SchedulerBase::VARIABLE, "in" + std::to_string(random(nInputs) )}};
+      for (std::size_t dep = 0; idx != 0 && dep < 2; ++dep)
+        dependencies.insert({RDFAnalysis::SchedulerBase::VARIABLE, variable(random(idx) )});
+      scheduler.addAction(
+          {RDFAnalysis::SchedulerBase::VARIABLE, variable(idx), 1.f + random(10)},
+          dependencies);
+      ++nActions;
+    }
+    // The pool of filters shared between the regions, each reading one or two
+    // variables
+    std::size_t nFilters = std::max<std::size_t>(
+        config.depth, config.nRegions * config.depth / config.sharing);
+    for (std::size_t idx = 0; idx < nFilters; ++idx) {
+      std::set<Action> dependencies;
+      for (std::size_t dep = 0; dep < 1 + random(2); ++dep)
+        dependencies.insert(
+            {RDFAnalysis::SchedulerBase::VARIABLE, variable(random(config.nVariables) )});
+      scheduler.addAction(
+          {RDFAnalysis::SchedulerBase::FILTER, "filter" + std::to_string(idx), 1.f + random(10)},
+          dependencies);
+      ++nActions;
+    }
+    for (std::size_t idx = 0; idx < config.nRegions; ++idx) {
+      std::string region = "region" + std::to_string(idx);
+      std::vector<std::string> filters;
+      while (filters.size() < config.depth) {
+        std::string filter = "filter" + std::to_string(random(nFilters) );
+        if (std::find(filters.begin(), filters.end(), filter) == filters.end() )
+          filters.push_back(filter);
+      }
+      auto& regionDef = scheduler.addRegion(region, filters);
+      for (std::size_t fill = 0; fill < config.nFills; ++fill) {
+        std::string name = region + "_fill" + std::to_string(fill);
+        scheduler.addAction(
+            {RDFAnalysis::SchedulerBase::FILL, name},
+            {{RDFAnalysis::SchedulerBase::VARIABLE, variable(random(config.nVariables) )}});
+        regionDef.addFill(name);
+        ++nActions;
+      }
+    }
+    return nActions;
+  }
+
+  /// Count the nodes in a schedule
+  std::size_t countNodes(const RDFAnalysis::SchedulerBase::ScheduleNode& node)
+  {
+    std::size_t count = 1;
+    for (const auto& child : node.children)
+      count += countNodes(child);
+    return count;
+  }
+} //> end anonymous namespace
+
+int main(int argc, char* argv[])
+{
+  std::size_t repeats = argc > 1 ? std::stoul(argv[1]) : 5;
+  std::vector<std::string> inputs;
+  for (std::size_t idx = 0; idx < nInputs; ++idx)
+    inputs.push_back("in" + std::to_string(idx) );
+
+  std::cout << std::setw(8) << "regions"
+            << std::setw(8) << "sharing"
+            << std::setw(10) << "actions"
+            << std::setw(10) << "nodes"
+            << std::setw(14) << "median [ms]"
+            << std::setw(12) << "min [ms]" << std::endl;
+  for (std::size_t nRegions : {10, 30, 100, 300}) {
+    for (std::size_t sharing : {1, 2, 5, 10}) {
+      Config config{nRegions, 5, sharing, 4 * nRegions, 3};
+      std::vector<double> times;
+      std::size_t nActions = 0;
+      std::size_t nNodes = 0;
+      for (std::size_t repeat = 0; repeat < repeats; ++repeat) {
+        // Use the same analysis for every repeat
+        std::mt19937 rng(nRegions * 100 + sharing);
+        BenchmarkScheduler scheduler;
+        RDFAnalysis::DefaultBranchNamer namer({});
+        for (const std::string& input : inputs)
+          namer.createBranch(input);
+        nActions = buildAnalysis(scheduler, config, rng);
+        auto start = std::chrono::steady_clock::now();
+        nNodes = countNodes(scheduler.schedule(namer) );
+        std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count() );
+      }
+      std::sort(times.begin(), times.end() );
+      std::cout << std::setw(8) << nRegions
+                << std::setw(8) << sharing
+                << std::setw(10) << nActions
+                << std::setw(10) << nNodes
+                << std::setw(14) << std::fixed << std::setprecision(3) << times.at(times.size() / 2)
+                << std::setw(12) << times.front() << std::endl;
+    }
+  }
+  return 0;
+}
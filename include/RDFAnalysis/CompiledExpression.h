@@ -0,0 +1,176 @@
+#ifndef RDFAnalysis_CompiledExpression_H
+#define RDFAnalysis_CompiledExpression_H
+
+// ROOT includes
+#include <ROOT/RDataFrame.hxx>
+
+// STL includes
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @file CompiledExpression.h
+ * @brief Compile string expressions once and apply them to many variations.
+ */
+
+namespace RDFAnalysis {
+  /**
+   * @brief Keep the compiled expressions in a directory between jobs
+   * @param directory The directory to use. If empty (the default) the
+   * expressions are only compiled in memory.
+   *
+   * Each batch of expressions is written to a file in the directory, named
+   * after a hash of its code, and compiled into a shared library with ACLiC.
+   * A later job producing the same batch loads that library instead of
+   * compiling anything. ACLiC only includes the RDataFrame header, so a batch
+   * using column types declared elsewhere (e.g. in a user dictionary) may
+   * fail to build. It is then compiled by the interpreter as if no directory
+   * had been set.
+   */
+  void setCompiledExpressionDirectory(const std::string& directory);
+
+  /**
+   * @brief Write every expression compiled so far to a C++ source file
+   * @param fileName The file to write
+   * @param headers Extra headers needed by the column types, written as they
+   * should appear after #include, e.g. "<TLorentzVector.h>"
+   *
+   * Compiling the file into an executable that uses the same expressions
+   * (with the RDFAnalysis_add_compiled_expressions CMake function) means that
+   * none of the string expressions have to be compiled by the interpreter
+   * when it runs: the functions are registered when the program starts and
+   * are found in place of compiling them. The file should therefore be
+   * written by a job that has already scheduled the complete analysis. Any
+   * expression that is not in the file is still compiled by the interpreter
+   * as usual, and detail::compiledBatchCount shows whether that happened.
+   *
+   * Only the string expressions are covered. For the rest of the analysis to
+   * run without the interpreter:
+   *  - fills must be registered with their column types (the typed
+   *    Scheduler::registerFill or NodeBase::Fill), as RDataFrame otherwise
+   *    works out the types with the interpreter,
+   *  - weights must be double or float columns,
+   *  - the columns of fills that are booked for several variations at once
+   *    (weight-only groups and delta fills) must be double, float, int,
+   *    unsigned int or bool, or vectors of double, float or int.
+   * Anything else is still booked through a string expression given to
+   * RDataFrame directly, which the interpreter compiles.
+   *
+   * The file must be added to the executable itself rather than to a static
+   * library, as otherwise the linker can drop the registration.
+   */
+  void writeCompiledExpressions(
+      const std::string& fileName,
+      const std::vector<std::string>& headers = {});
+
+  namespace detail {
+    /// An expression template to be compiled ahead of its use
+    struct ExpressionRequest {
+      /// Whether the template is used by a filter rather than a define
+      bool filter;
+      /// The expression template
+      std::string expression;
+      /// The columns substituted into the template
+      std::vector<std::string> columns;
+    }; //> end struct ExpressionRequest
+
+    /**
+     * @brief Compile several expression templates together
+     * @param rnode The RNode holding the templates' columns
+     * @param requests The templates
+     * @return Whether the compilation succeeded
+     *
+     * All of the templates that have not been compiled yet are compiled in a
+     * single translation unit, rather than one at a time as defineCompiled
+     * and filterCompiled would. Templates that can be evaluated without the
+     * interpreter are skipped. On failure nothing is compiled and each
+     * template is compiled (and any error reported) when it is first used.
+     */
+    bool compileExpressions(
+        ROOT::RDF::RNode& rnode,
+        const std::vector<ExpressionRequest>& requests);
+
+    /**
+     * @brief Add a precompiled expression template
+     * @param key The key of the template
+     * @param booker The function booking the template's action
+     * @param extraColumns Columns used by the template that were not among its
+     * inputs
+     * @param function The name of the function
+     * @param code The definition of the function
+     *
+     * Only to be called from the code written by writeCompiledExpressions.
+     */
+    void registerCompiledExpression(
+        const std::string& key,
+        void (*booker)(
+          ROOT::RDF::RNode*,
+          ROOT::RDF::RNode*,
+          const std::string*,
+          const std::vector<std::string>*),
+        const std::vector<std::string>& extraColumns,
+        const std::string& function,
+        const std::string& code);
+
+    /**
+     * @brief The number of batches of expression templates compiled in this
+     * process
+     *
+     * Every batch compiled by the interpreter or by ACLiC, or loaded from the
+     * directory set by setCompiledExpressionDirectory, is counted. Templates
+     * registered by a file written by writeCompiledExpressions are not, so
+     * this stays at zero in a program that only uses those.
+     */
+    std::size_t compiledBatchCount();
+
+    /**
+     * @brief Define a column from an expression template
+     * @param rnode The RNode to define the column on
+     * @param name The name of the new column
+     * @param expression The expression template, as produced by
+     * IBranchNamer::expandExpression, with {i} standing for the ith column
+     * @param columns The columns to substitute into the template
+     * @return The new RNode
+     *
+     * RNode::Define compiles every string expression that it receives. As
+     * each systematic variation of an expression refers to different columns
+     * the same expression would be compiled once per variation. Instead the
+     * template is compiled into a function taking its columns as arguments,
+     * which books the typed RNode::Define. This is done once per template and
+     * combination of column types and the function is then reused for every
+     * variation.
+     *
+     * Columns of the RNode that the namer does not know about (including
+     * rdfentry_ and rdfslot_) can still be used in the template, they are
+     * passed to the function in the same way.
+     *
+     * Templates supported by defineEvaluated are booked through it instead,
+     * without involving the interpreter.
+     */
+    ROOT::RDF::RNode defineCompiled(
+        ROOT::RDF::RNode& rnode,
+        const std::string& name,
+        const std::string& expression,
+        const std::vector<std::string>& columns);
+
+    /**
+     * @brief Filter on an expression template
+     * @param rnode The RNode to filter
+     * @param expression The expression template, as produced by
+     * IBranchNamer::expandExpression, with {i} standing for the ith column
+     * @param columns The columns to substitute into the template
+     * @param filterName The name of the filter
+     * @return The filtered RNode
+     *
+     * The filter equivalent of defineCompiled.
+     * Templates supported by filterEvaluated are booked through it instead.
+     */
+    ROOT::RDF::RNode filterCompiled(
+        ROOT::RDF::RNode& rnode,
+        const std::string& expression,
+        const std::vector<std::string>& columns,
+        const std::string& filterName);
+  } //> end namespace detail
+} //> end namespace RDFAnalysis
+#endif //> !RDFAnalysis_CompiledExpression_H
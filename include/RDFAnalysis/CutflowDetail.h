@@ -21,7 +21,7 @@ namespace RDFAnalysis {
         m_stats(node.Count() ),
         m_weightedStats( 
             node.getWeight().empty() ?
-            SysResultPtr<std::pair<float,float>>(node.namer().nominalName() ) :
+            SysResultPtr<std::pair<float,float>>(node.namer().registryPtr() ) :
             node.Aggregate(
               [] (const std::pair<float, float>& lhs, float rhs)
               { return std::make_pair(lhs.first + rhs, lhs.second + rhs*rhs); },
@@ -38,6 +38,13 @@ namespace RDFAnalysis {
       SysResultPtr<std::pair<float, float>> weightedStats()
       { return m_weightedStats; }
 
+      /// Drop the results for a variation removed by Node::pruneVariations
+      void dropVariation(SysID_t syst)
+      {
+        m_stats.removeResult(syst);
+        m_weightedStats.removeResult(syst);
+      }
+
     private:
       /// Unweighted cutflow information
       SysResultPtr<ULong64_t> m_stats;
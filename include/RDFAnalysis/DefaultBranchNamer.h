@@ -37,44 +37,47 @@ namespace RDFAnalysis {
           bool systNameFirst = true,
           bool inputFromFriends = false,
           const std::string& nominalName = "NOSYS") :
-        m_systematics(systematics),
+        IBranchNamer(nominalName, systematics),
         m_systNameFirst(systNameFirst),
-        m_inputFromFriendTrees(inputFromFriends),
-        m_nominalName(nominalName) {}
+        m_inputFromFriendTrees(inputFromFriends) {}
+
+      using IBranchNamer::nameBranch;
+      using IBranchNamer::createBranch;
+      using IBranchNamer::exists;
 
       /**
        * @brief Get the full name of a branch
        * @param branch The base name of the branch
-       * @param systName The name of the variation
+       * @param syst The ID of the variation
        *
-       * Search for a variation systName on a branch branch. If one doesn't
-       * exist then it will return the nominal branch. If that doesn't exist it
-       * will throw a std::out_of_range exception.
+       * Search for a variation syst on a branch branch. If one doesn't exist
+       * then it will return the nominal branch. If that doesn't exist it will
+       * throw a std::out_of_range exception.
        */
       std::string nameBranch(
           const std::string& branch,
-          const std::string& systName = "") const override;
+          SysID_t syst) const override;
 
       /**
        * @brief Get the full name of a branch
        * @param branch The base name of the branch
-       * @param systName The name of the variation
+       * @param syst The ID of the variation
        *
-       * Create a new variation systName of branch branch. If this already
-       * exists then a std::runtime_error will be thrown.
+       * Create a new variation syst of branch branch. If this already exists
+       * then a std::runtime_error will be thrown.
        */
       std::string createBranch(
           const std::string& branch,
-          const std::string& systName = "") override;
+          SysID_t syst) override;
 
       /**
        * @brief Test if a specific variation of a specific branch exists
        * @param branch The base name of the branch
-       * @param systName The name of the variation
+       * @param syst The ID of the variation
        */
       bool exists(
           const std::string& branch,
-          const std::string& systName = "") const override;
+          SysID_t syst) const override;
 
       /**
        * @brief Get the full name of a branch
@@ -85,22 +88,15 @@ namespace RDFAnalysis {
           const std::string& branch,
           const std::string& systName = "") const;
 
-      /// Print the name of the nominal variation
-      const std::string& nominalName() const override { return m_nominalName; }
-
-      /**
-       * @brief Get all systematics.
-       */
-      std::vector<std::string> systematics() const override
-      { return m_systematics; }
-
       /**
        * @brief Get all systematics affecting a base branch name.
        * @param branch The name of the branch to test
        */
-      std::set<std::string> systematicsAffecting(
+      SystematicMask affectingMask(
           const std::string& branch) const override;
 
+      using IBranchNamer::affectingMask;
+
       /**
        * @brief Get all branch base names
        */
@@ -110,17 +106,27 @@ namespace RDFAnalysis {
        * @brief Set the node that this namer is looking at
        * @param rnodes The input rnodes.
        */
-       void readBranchList( const std::map<std::string, ROOT::RDF::RNode>& rnodes ) override;
+       void readBranchList( const std::map<SysID_t, ROOT::RDF::RNode>& rnodes ) override;
 
        std::unique_ptr<IBranchNamer> copy() const override
        { return std::make_unique<DefaultBranchNamer>(*this); }
     private:
+      /// The variations of a single branch
+      struct BranchVariations {
+        /// The column names, keyed by systematic ID
+        std::map<SysID_t, std::string> columns;
+        /// The systematics present in columns
+        SystematicMask affecting;
+      }; //> end struct BranchVariations
+
+      /// Record a column as a variation of a branch
+      void addVariation(
+          const std::string& branch,
+          SysID_t syst,
+          const std::string& column);
 
       /// The branches
-      std::map<std::string, std::map<std::string, std::string>> m_branches;
-
-      /// The list of systematics
-      std::vector<std::string> m_systematics;
+      std::map<std::string, BranchVariations> m_branches;
 
       /// Whether when naming new branches (or reading existing ones) the
       /// systematic name should come first.
@@ -129,9 +135,6 @@ namespace RDFAnalysis {
       /// Whether the input is being read from friend trees
       bool m_inputFromFriendTrees{true};
 
-      /// The name of the nominal variation
-      std::string m_nominalName{"NOSYS"};
-
   }; //> end class DefaultBranchNamer
 } //> end namespace RDFAnalysis
 #endif //gb> !RDFAnalysis_BranchNamer_H
@@ -0,0 +1,165 @@
+#ifndef RDFAnalysis_DeltaHistogram_H
+#define RDFAnalysis_DeltaHistogram_H
+
+// ROOT includes
+#include <TH1.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @file DeltaHistogram.h
+ * @brief Sparse differences of histogram variations from their nominal.
+ */
+
+namespace RDFAnalysis {
+  /**
+   * @brief Sparse differences of several variations of a histogram from the
+   * nominal
+   * @tparam T The histogram type
+   *
+   * For each variation only the cells in which it differs from the nominal
+   * histogram are stored, so a variation that rarely moves an entry into a
+   * different bin (or rarely changes its weight) costs almost nothing. The
+   * nominal histogram itself is not held: it is filled as usual and passed in
+   * when the full histogram of a variation is requested by histogram().
+   *
+   * Variation 0 is taken to be the nominal and never holds any differences.
+   * Histograms whose axes can extend are not supported.
+   */
+  template <typename T>
+    class DeltaHistogram {
+      public:
+        /**
+         * @brief Create the histogram
+         * @param model The histogram defining the binning
+         * @param nVariations The number of variations, including the nominal
+         */
+        DeltaHistogram(const T& model, std::size_t nVariations) :
+          m_model(model),
+          m_deltas(nVariations),
+          m_entries(nVariations, 0)
+        {
+          m_model.SetDirectory(nullptr);
+          m_model.Reset();
+        }
+
+        /// The number of variations, including the nominal
+        std::size_t nVariations() const { return m_deltas.size(); }
+
+        /// Find the cell containing a set of values
+        int FindBin(double x, double y, double z) { return m_model.FindBin(x, y, z); }
+
+        /**
+         * @brief Add an entry to a variation that the nominal does not have
+         * @param variation The index of the variation
+         * @param cell The cell of the entry
+         * @param w The weight of the entry
+         */
+        void add(std::size_t variation, int cell, double w)
+        {
+          std::pair<double, double>& delta = m_deltas[variation][cell];
+          delta.first += w;
+          delta.second += w*w;
+        }
+
+        /**
+         * @brief Remove an entry of the nominal that a variation does not have
+         * @param variation The index of the variation
+         * @param cell The cell of the nominal entry
+         * @param w The weight of the nominal entry
+         */
+        void remove(std::size_t variation, int cell, double w)
+        {
+          std::pair<double, double>& delta = m_deltas[variation][cell];
+          delta.first -= w;
+          delta.second -= w*w;
+        }
+
+        /// Change the number of entries of a variation relative to the nominal
+        void addEntries(std::size_t variation, double nEntries)
+        {
+          m_entries[variation] += nEntries;
+        }
+
+        /// The number of cells in which a variation differs from the nominal
+        std::size_t nDeltas(std::size_t variation) const
+        {
+          return m_deltas.at(variation).size();
+        }
+
+        /**
+         * @brief Add the differences held by another object
+         */
+        void Add(const DeltaHistogram& other)
+        {
+          if (other.nVariations() != nVariations() )
+            throw std::invalid_argument(
+                "Cannot add DeltaHistograms with different numbers of variations");
+          for (std::size_t var = 0; var < nVariations(); ++var) {
+            for (const auto& cellPair : other.m_deltas[var]) {
+              std::pair<double, double>& delta = m_deltas[var][cellPair.first];
+              delta.first += cellPair.second.first;
+              delta.second += cellPair.second.second;
+            }
+            m_entries[var] += other.m_entries[var];
+          }
+        }
+
+        /**
+         * @brief Get the full histogram for one variation
+         * @param variation The index of the variation
+         * @param nominal The filled nominal histogram
+         *
+         * The histogram is created on the first call and then kept.
+         */
+        T* histogram(std::size_t variation, const T& nominal)
+        {
+          if (variation == 0 || variation >= nVariations() )
+            throw std::out_of_range(
+                "Variation " + std::to_string(variation) + " requested from a "
+                "DeltaHistogram with " + std::to_string(nVariations() ) );
+          std::lock_guard<std::mutex> lock(m_mutex);
+          std::unique_ptr<T>& hist = m_histograms[variation];
+          if (!hist) {
+            hist.reset(new T(nominal) );
+            hist->SetDirectory(nullptr);
+            if (hist->GetSumw2N() == 0)
+              hist->Sumw2();
+            for (const auto& cellPair : m_deltas[variation]) {
+              int cell = cellPair.first;
+              double error = hist->GetBinError(cell);
+              hist->SetBinContent(cell,
+                  hist->GetBinContent(cell) + cellPair.second.first);
+              hist->SetBinError(cell, std::sqrt(std::max(0.,
+                      error*error + cellPair.second.second) ) );
+            }
+            hist->SetEntries(nominal.GetEntries() + m_entries[variation]);
+            hist->ResetStats();
+          }
+          return hist.get();
+        }
+
+      private:
+        /// The model, used to find the bins
+        T m_model;
+        /// The changes to the sums of weights and squared weights, by cell
+        std::vector<std::unordered_map<int, std::pair<double, double>>> m_deltas;
+        /// The changes to the number of entries
+        std::vector<double> m_entries;
+        /// Histograms already created for each variation
+        std::map<std::size_t, std::unique_ptr<T>> m_histograms;
+        /// Protect the creation of the histograms
+        std::mutex m_mutex;
+    }; //> end class DeltaHistogram
+} //> end namespace RDFAnalysis
+#endif //> !RDFAnalysis_DeltaHistogram_H
@@ -0,0 +1,81 @@
+#ifndef RDFAnalysis_ExpressionEvaluator_H
+#define RDFAnalysis_ExpressionEvaluator_H
+
+// ROOT includes
+#include <ROOT/RDataFrame.hxx>
+
+// STL includes
+#include <string>
+#include <vector>
+
+/**
+ * @file ExpressionEvaluator.h
+ * @brief Evaluate simple string expressions without the interpreter.
+ */
+
+namespace RDFAnalysis { namespace detail {
+  /**
+   * @brief Whether an expression template can be evaluated without the
+   * interpreter
+   * @param rnode The RNode holding the template's columns
+   * @param expression The expression template, as produced by
+   * IBranchNamer::expandExpression, with {i} standing for the ith column
+   * @param columns The columns to substitute into the template
+   *
+   * The supported templates are built from
+   *  - numbers, true and false,
+   *  - the placeholders, where the column holds a double, float, int or bool,
+   *  - the arithmetic, comparison and logical operators and parentheses,
+   *  - the functions abs, fabs, sqrt, exp, log and pow, optionally
+   *    prefixed by std::.
+   * A Define must also have a floating point or bool result, so that the new
+   * column has the type that the interpreter would have given it.
+   * Calculations are done following the C++ rules for the column types.
+   */
+  bool canEvaluate(
+      ROOT::RDF::RNode& rnode,
+      const std::string& expression,
+      const std::vector<std::string>& columns,
+      bool filter);
+
+  /**
+   * @brief Define a column by evaluating an expression template
+   * @param rnode The RNode to define the column on
+   * @param[out] output The new RNode
+   * @param name The name of the new column
+   * @param expression The expression template
+   * @param columns The columns to substitute into the template
+   * @return False if the template is not supported, in which case nothing is
+   * booked
+   *
+   * The template is parsed (once per template and combination of column
+   * types), constant subexpressions are folded and the rest is turned into a
+   * short program that is run for each event.
+   */
+  bool defineEvaluated(
+      ROOT::RDF::RNode& rnode,
+      ROOT::RDF::RNode& output,
+      const std::string& name,
+      const std::string& expression,
+      const std::vector<std::string>& columns);
+
+  /**
+   * @brief Filter by evaluating an expression template
+   * @param rnode The RNode to filter
+   * @param[out] output The filtered RNode
+   * @param expression The expression template
+   * @param columns The columns to substitute into the template
+   * @param filterName The name of the filter
+   * @return False if the template is not supported, in which case nothing is
+   * booked
+   *
+   * The filter equivalent of defineEvaluated.
+   */
+  bool filterEvaluated(
+      ROOT::RDF::RNode& rnode,
+      ROOT::RDF::RNode& output,
+      const std::string& expression,
+      const std::vector<std::string>& columns,
+      const std::string& filterName);
+} } //> end namespace RDFAnalysis::detail
+#endif //> !RDFAnalysis_ExpressionEvaluator_H
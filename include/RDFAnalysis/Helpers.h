@@ -5,6 +5,9 @@
 #include <TDirectory.h>
 #include <ROOT/RDataFrame.hxx>
 #include <random>
+#include <functional>
+#include <ostream>
+#include <string>
 
 /**
  * @file Helpers.h
@@ -128,6 +131,22 @@ namespace RDFAnalysis {
   /// Could perhaps be more natural in the IBranchNamer?
   std::string uniqueBranchName(const std::string& stub = "GenBranch");
 
+  /**
+   * @brief Write a file so that nobody else can see it half-written
+   * @param fileName The file to write
+   * @param write Writes the contents of the file to the stream it receives
+   * @return False if the file could not be moved into place, which normally
+   * means that another job has just written it
+   *
+   * The contents are written to a temporary file with a unique name next to
+   * fileName, which is then renamed to fileName. Several jobs can therefore
+   * write the same file at once, and each reader sees one complete version.
+   * Errors while writing the contents throw a std::runtime_error.
+   */
+  bool writeFileAtomically(
+      const std::string& fileName,
+      const std::function<void(std::ostream&)>& write);
+
   template <typename F>
     struct is_std_function : public std::false_type {};
 
@@ -9,6 +9,8 @@
 
 #include <ROOT/RDataFrame.hxx>
 
+#include "RDFAnalysis/SystematicRegistry.h"
+
 /**
  * @file IBranchNamer.h
  * @brief The branch naming interface.
@@ -29,6 +31,10 @@ namespace RDFAnalysis {
    * That mapping is provided by this class, along with other useful information
    * such as the full list of systematics, the name of the nominal systematic
    * and a list of all defined variables.
+   *
+   * Systematics are identified internally by the integer IDs assigned by the
+   * namer's SystematicRegistry. The functions taking systematic names are thin
+   * wrappers around the ID versions and are kept for convenience.
    */
   class IBranchNamer {
     public:
@@ -37,73 +43,163 @@ namespace RDFAnalysis {
       /**
        * @brief Get the full name of a branch
        * @param branch The base name of the branch
-       * @param systName The name of the variation
+       * @param syst The ID of the variation
        *
-       * Search for a variation systName on a branch branch. If one
-       * doesn't exist then it will return the nominal branch. If that doesn't
-       * exist it will throw a std::out_of_range exception.
+       * Search for a variation syst on a branch branch. If one doesn't exist
+       * then it will return the nominal branch. If that doesn't exist it will
+       * throw a std::out_of_range exception.
        */
       virtual std::string nameBranch(
           const std::string& branch,
-          const std::string& systName = "") const = 0;
+          SysID_t syst) const = 0;
+
+      /**
+       * @brief Get the full name of a branch
+       * @param branch The base name of the branch
+       * @param systName The name of the variation
+       *
+       * Forwards to the SysID_t overload.
+       */
+      std::string nameBranch(
+          const std::string& branch,
+          const std::string& systName = "") const
+      { return nameBranch(branch, registry().id(systName) ); }
 
       /**
        * @brief Get the full names of a list of branches
        * @param branches The base name of the branches
-       * @param systName The name of the variation
+       * @param syst The ID of the variation
        *
-       * Search for a variation systName on a branch branch. If one doesn't
-       * exist then it will return the nominal branch. If that doesn't exist it
-       * will throw a std::out_of_range exception.
+       * Search for a variation syst on a branch branch. If one doesn't exist
+       * then it will return the nominal branch. If that doesn't exist it will
+       * throw a std::out_of_range exception.
        */
       virtual std::vector<std::string> nameBranches(
           const std::vector<std::string>& branches,
-          const std::string& systName = "") const;
+          SysID_t syst) const;
+
+      /**
+       * @brief Get the full names of a list of branches
+       * @param branches The base name of the branches
+       * @param systName The name of the variation
+       *
+       * Forwards to the SysID_t overload.
+       */
+      std::vector<std::string> nameBranches(
+          const std::vector<std::string>& branches,
+          const std::string& systName = "") const
+      { return nameBranches(branches, registry().id(systName) ); }
 
       /**
        * @brief Create a new branch
        * @param branch The base name of the branch
-       * @param systName The name of the variation
+       * @param syst The ID of the variation
        * @return The new branch name
        *
-       * Create a new variation systName of branch branch. If this already
-       * exists then a std::runtime_error will be thrown.
+       * Create a new variation syst of branch branch. If this already exists
+       * then a std::runtime_error will be thrown.
        */
       virtual std::string createBranch(
           const std::string& branch,
-          const std::string& systName = "") = 0;
+          SysID_t syst) = 0;
 
       /**
-       * @brief Test if a specific variation of a specific branch exists
+       * @brief Create a new branch
        * @param branch The base name of the branch
        * @param systName The name of the variation
+       * @return The new branch name
+       *
+       * Forwards to the SysID_t overload.
+       */
+      std::string createBranch(
+          const std::string& branch,
+          const std::string& systName = "")
+      { return createBranch(branch, registry().id(systName) ); }
+
+      /**
+       * @brief Test if a specific variation of a specific branch exists
+       * @param branch The base name of the branch
+       * @param syst The ID of the variation
        */
       virtual bool exists(
           const std::string& branch,
-          const std::string& systName = "") const = 0;
+          SysID_t syst) const = 0;
+
+      /**
+       * @brief Test if a specific variation of a specific branch exists
+       * @param branch The base name of the branch
+       * @param systName The name of the variation
+       */
+      bool exists(
+          const std::string& branch,
+          const std::string& systName = "") const
+      {
+        SysID_t syst = registry().find(systName);
+        return syst != SystematicRegistry::npos && exists(branch, syst);
+      }
+
+      /**
+       * @brief Declare a group of systematics only consumed through summaries
+       * @param name The name of the group
+       * @param systematics The systematics in the group
+       *
+       * Histograms filled with only the weights of the group's members hold
+       * the per-bin minimum, maximum, sum and sum of squares over the members
+       * instead of one histogram per member. See
+       * SystematicRegistry::declareGroup.
+       */
+      const SystematicGroup& declareGroup(
+          const std::string& name,
+          const std::set<std::string>& systematics)
+      { return m_registry->declareGroup(name, systematics); }
+
+      /// The registry mapping systematic names to IDs
+      const SystematicRegistry& registry() const { return *m_registry; }
+
+      /// The registry mapping systematic names to IDs
+      std::shared_ptr<const SystematicRegistry> registryPtr() const
+      { return m_registry; }
 
       /// Get the name of the nominal variation
-      virtual const std::string& nominalName() const = 0;
+      const std::string& nominalName() const
+      { return m_registry->nominalName(); }
 
       /**
        * @brief Get all systematics.
        */
-      virtual std::vector<std::string> systematics() const = 0;
+      const std::vector<std::string>& systematics() const
+      { return m_registry->names(); }
 
       /**
        * @brief Get all systematics affecting a base branch name.
        * @param branch The name of the branch to test
        */
-      virtual std::set<std::string> systematicsAffecting(
+      virtual SystematicMask affectingMask(
           const std::string& branch) const = 0;
 
       /**
        * @brief Get all the systematics affecting a set of columns.
        * @param branches The names of the branches to test
        */
-      virtual std::set<std::string> systematicsAffecting(
+      virtual SystematicMask affectingMask(
           const std::vector<std::string>& branches) const;
 
+      /**
+       * @brief Get the names of all systematics affecting a base branch name.
+       * @param branch The name of the branch to test
+       */
+      std::set<std::string> systematicsAffecting(
+          const std::string& branch) const
+      { return registry().names(affectingMask(branch) ); }
+
+      /**
+       * @brief Get the names of all the systematics affecting a set of columns.
+       * @param branches The names of the branches to test
+       */
+      std::set<std::string> systematicsAffecting(
+          const std::vector<std::string>& branches) const
+      { return registry().names(affectingMask(branches) ); }
+
       /**
        * @brief Get all branch base names
        */
@@ -111,10 +207,10 @@ namespace RDFAnalysis {
 
       /**
        * @brief Read branch lists from a set of rnodes
-       * @param rnodes The input rnodes
+       * @param rnodes The input rnodes, keyed by systematic ID
        */
       virtual void readBranchList(
-          const std::map<std::string, ROOT::RDF::RNode>& rnodes) = 0;
+          const std::map<SysID_t, ROOT::RDF::RNode>& rnodes) = 0;
 
       /// Make a copy of this class
       virtual std::unique_ptr<IBranchNamer> copy() const = 0;
@@ -140,7 +236,7 @@ namespace RDFAnalysis {
        *
        * @param expression The pseudo-functional expression to use
        * @param branches The input variables to the expression
-       * @param systematic The systematic variation to use
+       * @param syst The ID of the systematic variation to use
        * @return The expression for the given systematic
        *
        * Reinterpret a pseudo-functional form produced by expandExpression
@@ -153,7 +249,42 @@ namespace RDFAnalysis {
       virtual std::string interpretExpression(
           const std::string& expression,
           const std::vector<std::string>& branches,
-          const std::string& systematic);
+          SysID_t syst);
+
+      /**
+       * @brief Interpret an expression for a given systematic variation.
+       *
+       * @param expression The pseudo-functional expression to use
+       * @param branches The input variables to the expression
+       * @param systematic The systematic variation to use
+       * @return The expression for the given systematic
+       *
+       * Forwards to the SysID_t overload.
+       */
+      std::string interpretExpression(
+          const std::string& expression,
+          const std::vector<std::string>& branches,
+          const std::string& systematic)
+      {
+        return interpretExpression(
+            expression, branches, registry().id(systematic) );
+      }
+
+    protected:
+      /**
+       * @brief Create the namer, registering its systematics
+       * @param nominalName The name of the nominal variation
+       * @param systematics The other variations
+       *
+       * The registry is shared by all copies of this namer.
+       */
+      IBranchNamer(
+          const std::string& nominalName = "",
+          const std::vector<std::string>& systematics = {});
+
+    private:
+      /// The systematic registry
+      std::shared_ptr<SystematicRegistry> m_registry;
 
   }; //> end class IBranchNamer
 } //> end namespace RDFAnalysis
@@ -124,6 +124,27 @@ namespace RDFAnalysis {
           return this;
         }
 
+      /**
+       * @brief Define a new variable, evaluating all of its systematic
+       * variations in one call
+       * @tparam F The functor type
+       * @param name The name of the column to define
+       * @param f The functor
+       * @param columns The input variables to the functor
+       * @return A non-owning pointer to this object.
+       *
+       * See NodeBase::DefineSys.
+       */
+      template <typename F>
+        Node* DefineSys(
+            const std::string& name,
+            F f,
+            const ColumnNames_t& columns)
+        {
+          NodeBase::DefineSys(name, f, columns);
+          return this;
+        }
+
       /**
        * @brief Create a filter on this node
        * @tparam F The functor type
@@ -133,8 +154,16 @@ namespace RDFAnalysis {
        * @param cutflowName How the new node appears in the cutflow
        * @param strategy Weighting strategy for this weight
        *
+       * @param weightOnlyColumns Any of the columns that only influence the
+       * weight
+       *
        * In this overload the functor calculates the pass decision and the
        * weight in one go, return std::make_tuple(pass, weight).
+       *
+       * By default every systematic affecting the columns is assumed to
+       * affect the decision, and so creates a new filtered RNode. Systematics
+       * that only affect the columns listed in weightOnlyColumns are only
+       * applied to the weight, so they do not split the tree.
        */
       template <typename F>
         std::enable_if_t<std::is_convertible<typename ROOT::TTraits::CallableTraits<F>::ret_type, std::tuple<bool, float>>::value, Node*> Filter(
@@ -142,7 +171,8 @@ namespace RDFAnalysis {
             const ColumnNames_t& columns = {},
             const std::string& name = "",
             const std::string& cutflowName = "",
-            WeightStrategy strategy = WeightStrategy::Default);
+            WeightStrategy strategy = WeightStrategy::Default,
+            const ColumnNames_t& weightOnlyColumns = {});
 
       /**
        * @brief Create a filter on this node
@@ -167,6 +197,33 @@ namespace RDFAnalysis {
             const std::string& weight = "",
             WeightStrategy strategy = WeightStrategy::Default);
 
+      /**
+       * @brief Create a filter on this node, evaluating all of its systematic
+       * variations in one call
+       * @tparam F The functor type
+       * @param f The functor
+       * @param columns The input variables to the functor
+       * @param name The name of the new node
+       * @param cutflowName How the new node appears in the cutflow
+       * @param weight Expression to calculate the node weight
+       * @param strategy Weighting strategy for this weight
+       *
+       * The functor takes its inputs in the same form as for DefineSys and
+       * returns a ROOT::RVec of pass decisions, one per variation. These are
+       * stored per event in a bitmask column and each variation's RNode
+       * only tests its own bit. This is worthwhile for filters affected by
+       * many systematics, where the usual Filter evaluates the predicate once
+       * per systematic.
+       */
+      template <typename F>
+        Node* FilterSys(
+            F f,
+            const ColumnNames_t& columns,
+            const std::string& name = "",
+            const std::string& cutflowName = "",
+            const std::string& weight = "",
+            WeightStrategy strategy = WeightStrategy::Default);
+
       /**
        * @brief Create a filter on this node
        * @param expression The expression to describe the filter
@@ -250,6 +307,8 @@ namespace RDFAnalysis {
        * @param cutflowName How the root node appears in the cutflow
        * @param weight Expression to calculate a weight.
        * @param strategy The weight strategy
+       * @param backend How systematic variations are evaluated. See
+       * SystematicsBackend for the trade-offs.
        */
       static std::unique_ptr<Node> createROOT(
           const RNode& rnode,
@@ -258,13 +317,33 @@ namespace RDFAnalysis {
           const std::string& name = "ROOT",
           const std::string& cutflowName = "Number of events",
           const std::string& weight = "",
-          WeightStrategy strategy = WeightStrategy::Default)
+          WeightStrategy strategy = WeightStrategy::Default,
+          SystematicsBackend backend = SystematicsBackend::Clone)
       {
         return std::unique_ptr<Node>(
             new Node(rnode, std::move(namer), isMC, 
-              name, cutflowName, weight, strategy) );
+              name, cutflowName, weight, strategy, backend) );
       }
 
+      /**
+       * @brief Drop systematic variations that nothing downstream consumes
+       * @param keepCutflows If true, any node with a cutflow name consumes all
+       * of its variations
+       * @return The number of RNodes dropped for each systematic
+       *
+       * A variation is consumed by a node if one of the node's objects (e.g.
+       * from Fill) has a result for it or, with keepCutflows, if the node
+       * appears in the cutflow. Variation RNodes in the tree below this node
+       * that are not consumed by their node or any of its descendants are
+       * removed, so RDataFrame never evaluates them. Results that the detail
+       * holds for them are dropped as well, if the detail provides a
+       * dropVariation(SysID_t) function. Later operations on these nodes do
+       * not rebuild the pruned variations (see droppedVariations), so this
+       * should be called once everything has been booked, just before the
+       * event loop is run.
+       */
+      std::map<SysID_t, std::size_t> pruneVariations(bool keepCutflows = true);
+
       /**
        * @brief Trigger the run
        * @param printEvery How often to print to the screen
@@ -295,6 +374,17 @@ namespace RDFAnalysis {
         void run(Monitor monitor);
 
     private:
+      /**
+       * @brief Recursive implementation of pruneVariations
+       * @param keepCutflows Whether nodes in the cutflow consume their
+       * variations
+       * @param pruned Count of the RNodes dropped for each systematic
+       * @return The variations consumed by this node or its descendants
+       */
+      SystematicMask pruneVariationsImpl(
+          bool keepCutflows,
+          std::map<SysID_t, std::size_t>& pruned);
+
       /**
        * @brief Create the root node of the tree
        * @param rnode The RDataFrame that forms the base of the tree
@@ -303,6 +393,7 @@ namespace RDFAnalysis {
        * @param cutflowName How the root node appears in the cutflow
        * @param weight Expression to calculate a weight.
        * @param strategy Weighting strategy for this weight
+       * @param backend How systematic variations are evaluated
        */
       Node(
           const RNode& rnode,
@@ -311,7 +402,8 @@ namespace RDFAnalysis {
           const std::string& name = "ROOT",
           const std::string& cutflowName = "Number of events",
           const std::string& weight = "",
-          WeightStrategy strategy = WeightStrategy::Default);
+          WeightStrategy strategy = WeightStrategy::Default,
+          SystematicsBackend backend = SystematicsBackend::Clone);
 
       /**
        * @brief Create the root node of the tree
@@ -323,6 +415,7 @@ namespace RDFAnalysis {
        * @param w Functor used to calculate the weight
        * @param columns The input columns for the weight
        * @param strategy Weighting strategy for this weight
+       * @param backend How systematic variations are evaluated
        */
       template <typename W>
         Node(
@@ -333,7 +426,8 @@ namespace RDFAnalysis {
             const std::string& cutflowName,
             W w,
             const ColumnNames_t& columns,
-            WeightStrategy strategy);
+            WeightStrategy strategy,
+            SystematicsBackend backend = SystematicsBackend::Clone);
 
       /**
        * @brief Create a child node
@@ -346,7 +440,7 @@ namespace RDFAnalysis {
        */
       Node(
           Node& parent,
-          std::map<std::string, RNode>&& rnodes,
+          std::map<SysID_t, RNode>&& rnodes,
           const std::string& name,
           const std::string& cutflowName,
           const std::string& weight,
@@ -367,7 +461,7 @@ namespace RDFAnalysis {
       template <typename W>
         Node(
             Node& parent,
-            std::map<std::string, RNode>&& rnodes,
+            std::map<SysID_t, RNode>&& rnodes,
             const std::string& name,
             const std::string& cutflowName,
             W w,
@@ -6,7 +6,11 @@
 #include "RDFAnalysis/Helpers.h"
 #include "RDFAnalysis/SysResultPtr.h"
 #include "RDFAnalysis/SysVar.h"
+#include "RDFAnalysis/SystematicsBackend.h"
 #include "RDFAnalysis/WeightStrategy.h"
+#include "RDFAnalysis/WeightVariedFill.h"
+#include "RDFAnalysis/TypedFill.h"
+#include "RDFAnalysis/PackColumns.h"
 
 // ROOT includes
 #include "ROOT/RDataFrame.hxx"
@@ -80,7 +84,9 @@ namespace RDFAnalysis {
        * The new column's data type will be the return type of the JITted
        * function. The expression should have the column names replaced by
        * placeholders like {idx} (where idx is the index of the branch in the
-       * columns vector).
+       * columns vector). The expression is only compiled once (for each set
+       * of column types), however many systematics affect it, see
+       * detail::defineCompiled.
        */
       NodeBase* Define(
           const std::string& name,
@@ -113,6 +119,37 @@ namespace RDFAnalysis {
             F f,
             const ColumnNames_t& columns);
 
+      /**
+       * @brief Define a new variable, evaluating all of its systematic
+       * variations in one call
+       * @tparam F The functor type
+       * @param name The name of the column to define
+       * @param f The functor
+       * @param columns The input variables to the functor
+       * @return A non-owning pointer to this object.
+       *
+       * The functor takes one const ROOT::RVec<T>& per input column and
+       * returns a ROOT::RVec<R>. Entry i of every input and of the output
+       * belongs to the same systematic variation, entry 0 being the nominal
+       * (or the variation of the RNode being evaluated). The variations of
+       * each input are packed into its vector by typed Defines (see
+       * detail::packEach), whose column types are taken from the functor's
+       * arguments, so no interpreter is needed. The columns must therefore
+       * hold exactly the functor's element types.
+       *
+       * Define calls the functor once per affecting systematic, each time
+       * reading its own copy of the inputs. Here the variations that live on
+       * the nominal RNode are all evaluated in a single call, which allows
+       * the functor to loop over (and the compiler to vectorise) them. The
+       * output is unpacked into the usual per-systematic branches so it can be
+       * used exactly as if it had been made by Define.
+       */
+      template <typename F>
+        NodeBase* DefineSys(
+            const std::string& name,
+            F f,
+            const ColumnNames_t& columns);
+
       /**
        * @brief Get the name of the weight branch.
        *
@@ -136,6 +173,19 @@ namespace RDFAnalysis {
        * for types inheriting from TH1 but other objects (particularly
        * user-defined ones) will behave differently. For these cases I will need
        * to specialise the 'Book' action.
+       *
+       * Systematics that affect the weight, but neither the filled columns nor
+       * the selection of this node, only change the weight of the fill. If
+       * there are several of these they are all filled by a single action,
+       * reading their weights from one vector per event, into one
+       * SysHistogram rather than booking one action (and one histogram per
+       * slot) per variation. This is only done for histograms whose dimension
+       * matches the number of columns.
+       *
+       * If all of the members of a systematic group (see
+       * IBranchNamer::declareGroup) that affect the fill only change its
+       * weight, only the summaries of that group are kept and written, rather
+       * than one histogram per member.
        */
       template <typename T>
         SysResultPtr<T> Fill(
@@ -144,6 +194,32 @@ namespace RDFAnalysis {
             const std::string& weight = "",
             WeightStrategy strategy = WeightStrategy::Default);
 
+      /**
+       * @brief Fill an object on each event, giving the types of its columns
+       * @tparam ColType The type of the first column
+       * @tparam ColTypes The types of the other columns
+       * @tparam T The type of object to be filled.
+       * @param model The 'model' object to fill.
+       * @param columns The columns to use for the object's Fill method.
+       * @param weight The column containing the weight information
+       * @param strategy The weight strategy to use
+       *
+       * Without the column types RDataFrame has to use the interpreter to
+       * book each Fill action, separately for every variation. Here the types
+       * are given directly, e.g. Fill<float>(TH1F(...), {"pt"}), and the
+       * interpreter is not needed as long as the weight (which is resolved
+       * separately for each variation) is a double or a float.
+       *
+       * Otherwise this behaves exactly like the untyped Fill.
+       */
+      template <typename ColType, typename... ColTypes, typename T,
+               typename = std::enable_if_t<!std::is_same<ColType, T>::value>>
+        SysResultPtr<T> Fill(
+            const T& model,
+            const ColumnNames_t& columns,
+            const std::string& weight = "",
+            WeightStrategy strategy = WeightStrategy::Default);
+
       /**
        * @brief Execute a user-defined accumulation function.
        * @tparam AccFun The type of the accumulation function
@@ -215,7 +291,7 @@ namespace RDFAnalysis {
        * @param f The action
        * @param columns The columns affected by the action
        * @param args The arguments to the action
-       * @return A map of systematic name to action return type
+       * @return A map of systematic ID to action return type
        *
        * Most functions on the Node classes get routed through this or one of
        * its overloads. It carries out the following operations:
@@ -228,12 +304,15 @@ namespace RDFAnalysis {
        * can be translated are. For information on argument translation see
        * SysVar.h
        *
+       * With the SystematicsBackend::Vary backend the action is only applied
+       * to the nominal RNode as RDataFrame propagates the variations itself.
+       *
        * The first parameter of f should be a ROOT::RNode&, this will be
        * provided by this function and should not be included in args, as it
        * will provide each systematically varied ROOT::RNode in turn.
        */
       template <typename... TrArgs, typename T, typename... Args>
-        std::map<std::string, T> Act(
+        std::map<SysID_t, T> Act(
             std::function<T(RNode&, TrArgs...)> f,
             const ColumnNames_t& columns,
             Args&&... args);
@@ -247,14 +326,14 @@ namespace RDFAnalysis {
        * @param f The action
        * @param columns The columns affected by the action
        * @param args The arguments to the action
-       * @return A map of systematic name to action return type
+       * @return A map of systematic ID to action return type
        *
        * Overload for non-member functions, will forward the call to
        * Node::Act<TrArgs, T, Args>.
        */
       template <typename F, typename... Args,
                typename T=typename ROOT::TTraits::CallableTraits<F>::ret_type>
-        std::enable_if_t<!is_std_function<F>::value, std::map<std::string, T>> Act(
+        std::enable_if_t<!is_std_function<F>::value, std::map<SysID_t, T>> Act(
             F&& f,
             const ColumnNames_t& columns,
             Args&&... args)
@@ -275,7 +354,7 @@ namespace RDFAnalysis {
        * @param f The action
        * @param columns The columns affected by the action
        * @param args The arguments to the action
-       * @return A map of systematic name to action return type
+       * @return A map of systematic ID to action return type
        *
        * Most functions on the Node classes get routed through this or one of
        * its overloads. It carries out the following operations:
@@ -288,12 +367,15 @@ namespace RDFAnalysis {
        * can be translated are. For information on argument translation see
        * SysVar.h
        *
+       * With the SystematicsBackend::Vary backend the action is only applied
+       * to the nominal RNode as RDataFrame propagates the variations itself.
+       *
        * This overload is selected when f is a member function of
        * ROOT::RNode. In this case is usually necessary to specify T and TrArgs
        * in the call.
        */
       template <typename T, typename... TrArgs, typename... Args>
-        std::map<std::string, T> Act(
+        std::map<SysID_t, T> Act(
             T (RNode::*f)(TrArgs...),
             const ColumnNames_t& columns,
             Args&&... args);
@@ -322,9 +404,7 @@ namespace RDFAnalysis {
             const ColumnNames_t& columns,
             Args&&... args)
         {
-          return SysResultPtr<U>(
-              namer().nominalName(),
-              Act(f, columns, std::forward<Args>(args)...) );
+          return makeSysResult(Act(f, columns, std::forward<Args>(args)...) );
         }
 
       /**
@@ -383,9 +463,7 @@ namespace RDFAnalysis {
             const ColumnNames_t& columns,
             Args&&... args)
         {
-          return SysResultPtr<U>(
-              namer().nominalName(),
-              Act(f, columns, std::forward<Args>(args)...) );
+          return makeSysResult(Act(f, columns, std::forward<Args>(args)...) );
         }
 
       /// Get the name
@@ -401,13 +479,64 @@ namespace RDFAnalysis {
       bool isMC() const { return m_isMC; }
 
       /// Get the RNode objects
-      const std::map<std::string, RNode>& rnodes() const { return m_rnodes; }
+      const std::map<SysID_t, RNode>& rnodes() const { return m_rnodes; }
       /// Get the RNode objects
-      std::map<std::string, RNode>& rnodes() { return m_rnodes; }
+      std::map<SysID_t, RNode>& rnodes() { return m_rnodes; }
 
       /// The namer
       const IBranchNamer& namer() const { return *m_namer; }
 
+      /// How this tree evaluates its systematic variations
+      SystematicsBackend systematicsBackend() const { return m_backend; }
+
+      /**
+       * @brief Exclude variations from everything booked on this node
+       * @param excluded The variations to exclude. The nominal is always kept.
+       *
+       * Actions and filters booked on this node while a variation is excluded
+       * do not evaluate it, even if this node has an RNode for it, and
+       * children created in that time never build it. This replaces any
+       * previous exclusions, except for the variations removed by pruning,
+       * so the usual pattern is to save excludedVariations, extend it for
+       * some actions and then restore it.
+       */
+      void setExcludedVariations(const SystematicMask& excluded)
+      {
+        m_prunedVariations = excluded | m_droppedVariations;
+        m_prunedVariations.reset(SystematicRegistry::nominalID);
+      }
+
+      /// The variations excluded from everything booked on this node
+      const SystematicMask& excludedVariations() const { return m_prunedVariations; }
+
+      /**
+       * @brief The variations whose RNodes were removed by pruning
+       *
+       * These are always excluded as well. Unlike other exclusions they are
+       * kept by setExcludedVariations, as the RNodes cannot be rebuilt.
+       */
+      const SystematicMask& droppedVariations() const { return m_droppedVariations; }
+
+      /**
+       * @brief Fill histograms with their differences from the nominal
+       * @param deltaFill Whether or not to use the delta mode
+       *
+       * In the delta mode every variation of a histogram that is evaluated on
+       * the nominal RNode (i.e. that does not change this node's selection) is
+       * filled by a single action. On each event this records only the
+       * entries whose bin or weight differ from the nominal, and the full
+       * histogram of each variation is built from the nominal and these
+       * differences when it is retrieved. This is much cheaper when most
+       * events are not moved between bins by most systematics. It is only
+       * used for histograms filled with a weight.
+       *
+       * The setting is inherited by children created after it is changed.
+       */
+      void setDeltaFill(bool deltaFill) { m_deltaFill = deltaFill; }
+
+      /// Whether histograms are filled with differences from the nominal
+      bool deltaFill() const { return m_deltaFill; }
+
       /// Iterate over the objects defined on this
       auto objects() { return as_range(m_objects); }
       /// (Const) iterate over all the objects defined on this
@@ -423,7 +552,7 @@ namespace RDFAnalysis {
         /// Initialise the name as part of the node's initialisation list
         NamerInitialiser(
             IBranchNamer& namer,
-            const std::map<std::string, ROOT::RDF::RNode>& rnodes) {
+            const std::map<SysID_t, ROOT::RDF::RNode>& rnodes) {
           namer.readBranchList(rnodes);
         }
       };
@@ -443,6 +572,213 @@ namespace RDFAnalysis {
             const std::tuple<Elements...>*);
 
 
+      /**
+       * @brief Get the systematics that only change the weight of a fill
+       * @param columns The filled columns
+       * @param weight The weight column
+       *
+       * These are the variations of the weight that affect neither the
+       * columns nor the selection of this node, so the fill of each would
+       * only differ in its weight. Nothing is returned for the Vary backend.
+       */
+      std::vector<SysID_t> weightOnlyVariations(
+          const ColumnNames_t& columns,
+          const std::string& weight) const;
+
+      /**
+       * @brief Get a column holding several variations of a weight
+       * @param weight The weight column
+       * @param systs The variations to include, in order
+       * @return The name of a ROOT::RVec<double> column on the nominal RNode
+       *
+       * The column is only defined once per node for each set of variations.
+       */
+      std::string weightVector(
+          const std::string& weight,
+          const std::vector<SysID_t>& systs);
+
+      /**
+       * @brief Get the nominal value of a column as a vector of doubles
+       * @param column The column to convert
+       * @return The name of a ROOT::RVec<double> column on the nominal RNode
+       *
+       * Scalar columns are converted to a vector of size one, so the result
+       * can be used by actions that do not know the type of the input.
+       */
+      std::string doublesColumn(const std::string& column);
+
+      /**
+       * @brief Get the values of a column in several variations as vectors of
+       * doubles
+       * @param column The column to convert
+       * @param systs The variations to include, in order
+       * @return The name of a ROOT::RVec<ROOT::RVec<double>> column on the
+       * nominal RNode
+       *
+       * Each variation is converted in the same way as by doublesColumn. The
+       * column is only defined once per node for each set of variations.
+       */
+      std::string variedDoublesColumn(
+          const std::string& column,
+          const std::vector<SysID_t>& systs);
+
+      /**
+       * @brief Implementation of both Fill methods
+       * @tparam T The type of object to be filled
+       * @tparam F The type of the function booking a single fill
+       * @param model The 'model' object to fill.
+       * @param columns The columns to use for the object's Fill method.
+       * @param weight The column containing the weight information
+       * @param strategy The weight strategy to use
+       * @param fill Books the fill of one variation from an RNode, a copy of
+       * the model and the columns (including any weight)
+       */
+      template <typename T, typename F>
+        SysResultPtr<T> fillImpl(
+            const T& model,
+            const ColumnNames_t& columns,
+            const std::string& weight,
+            WeightStrategy strategy,
+            F fill);
+
+      /**
+       * @brief Fill the weight-only variations of a histogram in one action
+       * @tparam T The histogram type
+       * @param result The result to add the variations to
+       * @param model The histogram to fill
+       * @param columns The filled columns
+       * @param weight The weight column
+       * @param systs The weight-only variations
+       */
+      template <typename T>
+        void fillWeightVariations(
+            SysResultPtr<T>& result,
+            const T& model,
+            const ColumnNames_t& columns,
+            const std::string& weight,
+            const std::vector<SysID_t>& systs,
+            std::true_type);
+
+      /// Overload for types that cannot be filled with a weight vector
+      template <typename T>
+        void fillWeightVariations(
+            SysResultPtr<T>&,
+            const T&,
+            const ColumnNames_t&,
+            const std::string&,
+            const std::vector<SysID_t>&,
+            std::false_type) {}
+
+      /**
+       * @brief Fill only the summaries of a group of variations of a histogram
+       * @tparam T The histogram type
+       * @param result The result to add the summaries to
+       * @param model The histogram to fill
+       * @param columns The filled columns
+       * @param weight The weight column
+       * @param group The group being summarised
+       * @param systs The members of the group, which only change the weight
+       */
+      template <typename T>
+        void fillGroupSummaries(
+            SysResultPtr<T>& result,
+            const T& model,
+            const ColumnNames_t& columns,
+            const std::string& weight,
+            const SystematicGroup& group,
+            const std::vector<SysID_t>& systs,
+            std::true_type);
+
+      /// Overload for types that cannot be filled with a weight vector
+      template <typename T>
+        void fillGroupSummaries(
+            SysResultPtr<T>&,
+            const T&,
+            const ColumnNames_t&,
+            const std::string&,
+            const SystematicGroup&,
+            const std::vector<SysID_t>&,
+            std::false_type) {}
+
+      /**
+       * @brief Fill the differences of variations of a histogram from the
+       * nominal in one action
+       * @tparam T The histogram type
+       * @param result The result holding the nominal, to add the variations to
+       * @param model The histogram to fill
+       * @param columns The filled columns
+       * @param weight The weight column
+       * @param systs The variations, starting with the nominal
+       */
+      template <typename T>
+        void fillDeltaVariations(
+            SysResultPtr<T>& result,
+            const T& model,
+            const ColumnNames_t& columns,
+            const std::string& weight,
+            const std::vector<SysID_t>& systs,
+            std::true_type);
+
+      /// Overload for types that cannot be filled with differences
+      template <typename T>
+        void fillDeltaVariations(
+            SysResultPtr<T>&,
+            const T&,
+            const ColumnNames_t&,
+            const std::string&,
+            const std::vector<SysID_t>&,
+            std::false_type) {}
+
+      /**
+       * @brief Group the systematics affecting some columns by the RNode on
+       * which they should be evaluated
+       * @param columns The input columns
+       * @return For each RNode's ID the variations to evaluate on it, the
+       * first always being the RNode's own
+       *
+       * This follows the same logic as Act: every RNode evaluates its own
+       * variation and the nominal also evaluates the remaining ones.
+       */
+      std::map<SysID_t, std::vector<SysID_t>> variationsByRNode(
+          const ColumnNames_t& columns) const;
+
+      /**
+       * @brief Evaluate a functor for several variations at once
+       * @tparam F The functor type
+       * @param rnode The RNode to evaluate the functor on
+       * @param f The functor
+       * @param columns The input variables to the functor
+       * @param systs The variations to evaluate
+       * @return The name of the column holding the functor's output
+       *
+       * Each input is packed into a ROOT::RVec holding its value for each of
+       * systs, in order. See DefineSys.
+       */
+      template <typename F>
+        std::string evaluateVariations(
+            RNode& rnode,
+            F f,
+            const ColumnNames_t& columns,
+            const std::vector<SysID_t>& systs);
+
+      /**
+       * @brief Create child RNodes to be used for a filter from this node,
+       * evaluating all variations of the predicate at once
+       * @tparam F The functor type
+       * @param f The functor, in the form described in Node::FilterSys
+       * @param columns The input variables to the functor
+       * @param cutflowName The cutflow name of these nodes
+       *
+       * On each RNode the predicate is evaluated once per event and its result
+       * stored as a bitmask, one bit per variation. Each child RNode then only
+       * tests its own bit.
+       */
+      template <typename F>
+        std::map<SysID_t, RNode> makeChildRNodesSys(
+            F f,
+            const ColumnNames_t& columns,
+            const std::string& cutflowName = "");
+
       /**
        * @brief Create child RNodes to be used for a filter from this node
        * @tparam F The functor type
@@ -451,7 +787,7 @@ namespace RDFAnalysis {
        * @param cutflowName The cutflow name of these nodes
        */
       template <typename F>
-        enable_ifn_string_t<F, std::map<std::string, RNode>> makeChildRNodes(
+        enable_ifn_string_t<F, std::map<SysID_t, RNode>> makeChildRNodes(
             F f,
             const ColumnNames_t& columns = {},
             const std::string& cutflowName = "");
@@ -461,7 +797,7 @@ namespace RDFAnalysis {
        * @param expression The expression to describe the filter
        * @param cutflowName The cutflow name of these nodes
        */
-      std::map<std::string, RNode> makeChildRNodes(
+      std::map<SysID_t, RNode> makeChildRNodes(
           const std::string& expression,
           const std::string& cutflowName = "");
 
@@ -473,9 +809,9 @@ namespace RDFAnalysis {
        *
        * The expression should have the column names replaced by placeholders
        * like {idx} (where idx is the index of the branch in the columns
-       * vector).
+       * vector). As for Define the expression is only compiled once.
        */
-      std::map<std::string, RNode> makeChildRNodes(
+      std::map<SysID_t, RNode> makeChildRNodes(
           const std::string& expression,
           const ColumnNames_t& columns,
           const std::string& cutflowName = "");
@@ -489,6 +825,7 @@ namespace RDFAnalysis {
        * @param cutflowName How the root node appears in the cutflow
        * @param weight Expression to calculate a weight.
        * @param strategy Weighting strategy for this weight
+       * @param backend How systematic variations are evaluated
        */
       NodeBase(
           const RNode& rnode,
@@ -497,7 +834,8 @@ namespace RDFAnalysis {
           const std::string& name = "ROOT",
           const std::string& cutflowName = "Number of events",
           const std::string& weight = "",
-          WeightStrategy strategy = WeightStrategy::Default);
+          WeightStrategy strategy = WeightStrategy::Default,
+          SystematicsBackend backend = SystematicsBackend::Clone);
 
       /**
        * @brief Create the root node of the tree
@@ -510,6 +848,7 @@ namespace RDFAnalysis {
        * @param w Functor used to calculate the weight
        * @param columns The input columns for the weight
        * @param strategy Weighting strategy for this weight
+       * @param backend How systematic variations are evaluated
        */
       template <typename W>
         NodeBase(
@@ -520,7 +859,8 @@ namespace RDFAnalysis {
             const std::string& cutflowName,
             W w,
             const ColumnNames_t& columns,
-            WeightStrategy strategy = WeightStrategy::Default);
+            WeightStrategy strategy = WeightStrategy::Default,
+            SystematicsBackend backend = SystematicsBackend::Clone);
 
       /**
        * @brief Create a child node
@@ -533,7 +873,7 @@ namespace RDFAnalysis {
        */
       NodeBase(
           NodeBase& parent,
-          std::map<std::string, RNode>&& rnodes,
+          std::map<SysID_t, RNode>&& rnodes,
           const std::string& name,
           const std::string& cutflowName,
           const std::string& weight,
@@ -552,7 +892,7 @@ namespace RDFAnalysis {
       template <typename W>
         NodeBase(
             NodeBase& parent,
-            std::map<std::string, RNode>&& rnodes,
+            std::map<SysID_t, RNode>&& rnodes,
             const std::string& name,
             const std::string& cutflowName,
             W w,
@@ -592,8 +932,35 @@ namespace RDFAnalysis {
       /// Internal function to name the weight branch
       std::string nameWeight();
 
-      /// The RNode objects, keyed by systematic
-      std::map<std::string, RNode> m_rnodes;      
+      /**
+       * @brief Prepare the root RNode for a systematics backend
+       * @param backend The requested backend
+       * @return The backend, so this can be called in an initialiser list
+       * @exception std::runtime_error If a systematic varies branches of
+       * different types
+       * @exception std::logic_error If the Vary backend is requested but this
+       * ROOT version does not support it
+       *
+       * For the Vary backend each systematic is declared on the nominal RNode
+       * with a single RNode::Vary call covering all of the input branches that
+       * the branch namer knows a variation of.
+       */
+      SystematicsBackend declareVariations(SystematicsBackend backend);
+
+      /**
+       * @brief Wrap the results of an action in a SysResultPtr
+       * @tparam U The type of the result
+       * @param results The results returned by Act
+       *
+       * With the Vary backend the varied results are retrieved from the
+       * nominal one through VariationsFor.
+       */
+      template <typename U>
+        SysResultPtr<U> makeSysResult(
+            std::map<SysID_t, ROOT::RDF::RResultPtr<U>>&& results);
+
+      /// The RNode objects, keyed by systematic ID
+      std::map<SysID_t, RNode> m_rnodes;      
 
       /// The branch namer
       std::unique_ptr<IBranchNamer> m_namer;
@@ -601,6 +968,19 @@ namespace RDFAnalysis {
       /// Helper struct to force early initialisation of the namer
       NamerInitialiser m_namerInit;
 
+      /// How systematic variations are evaluated
+      SystematicsBackend m_backend;
+
+      /// Variations removed by pruning or otherwise excluded, which must not
+      /// be rebuilt
+      SystematicMask m_prunedVariations;
+
+      /// Variations whose RNodes have been removed by pruning
+      SystematicMask m_droppedVariations;
+
+      /// Whether histograms are filled with differences from the nominal
+      bool m_deltaFill = false;
+
       /// Whether or not 'MC' mode was activated
       bool m_isMC;
 
@@ -618,6 +998,15 @@ namespace RDFAnalysis {
 
       /// Any TObject pointers declared on this
       std::vector<SysResultPtr<TObject>> m_objects;
+
+      /// Columns created by weightVector, keyed by weight and variations
+      std::map<std::pair<std::string, std::vector<SysID_t>>, std::string> m_weightVectors;
+
+      /// Columns created by doublesColumn, keyed by the input column
+      std::map<std::string, std::string> m_doublesColumns;
+
+      /// Columns created by variedDoublesColumn, keyed by column and variations
+      std::map<std::pair<std::string, std::vector<SysID_t>>, std::string> m_variedDoublesColumns;
   }; //> end class NodeBase
 } //> end namespace RDFAnalysis
 #include "RDFAnalysis/NodeBase.icc"
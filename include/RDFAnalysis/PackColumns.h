@@ -0,0 +1,299 @@
+#ifndef RDFAnalysis_PackColumns_H
+#define RDFAnalysis_PackColumns_H
+
+// Package includes
+#include "RDFAnalysis/Helpers.h"
+
+// ROOT includes
+#include <ROOT/RDataFrame.hxx>
+
+// STL includes
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @file PackColumns.h
+ * @brief Typed actions collecting several columns into one vector.
+ */
+
+namespace RDFAnalysis { namespace detail {
+  /// Converter storing the values of a column unchanged
+  template <typename T>
+    struct Copy {
+      /// The type of the column
+      using input_t = T;
+      /// Convert a value
+      static const T& convert(const T& value) { return value; }
+    };
+
+  /// Converter storing the values of a column as doubles
+  template <typename T>
+    struct ToDouble {
+      /// The type of the column
+      using input_t = T;
+      /// Convert a value
+      static double convert(const T& value) { return value; }
+    };
+
+  /**
+   * @brief Converter storing the values of a column as vectors of doubles
+   *
+   * Containers are converted element by element, as in RNode::Fill, and any
+   * other value becomes a vector of one element.
+   */
+  template <typename T>
+    struct ToDoubles {
+      /// The type of the column
+      using input_t = T;
+      /// Convert a value
+      static ROOT::VecOps::RVec<double> convert(const T& value)
+      {
+        return ROOT::VecOps::RVec<double>{static_cast<double>(value)};
+      }
+    };
+
+  template <typename T>
+    struct ToDoubles<ROOT::VecOps::RVec<T>> {
+      using input_t = ROOT::VecOps::RVec<T>;
+      static ROOT::VecOps::RVec<double> convert(const input_t& value)
+      {
+        return ROOT::VecOps::RVec<double>(value.begin(), value.end() );
+      }
+    };
+
+  template <typename T>
+    struct ToDoubles<std::vector<T>> {
+      using input_t = std::vector<T>;
+      static ROOT::VecOps::RVec<double> convert(const input_t& value)
+      {
+        return ROOT::VecOps::RVec<double>(value.begin(), value.end() );
+      }
+    };
+
+  /// Carries a type to a generic lambda
+  template <typename T>
+    struct TypeTag {
+      using type = T;
+    };
+
+  /// Bring a column type given by RNode::GetColumnType to a standard form
+  inline std::string normalizeColumnType(std::string type)
+  {
+    type.erase(std::remove(type.begin(), type.end(), ' '), type.end() );
+    auto replaceAll = [&type] (const std::string& from, const std::string& to) {
+      for (std::size_t pos = type.find(from); pos != std::string::npos;
+          pos = type.find(from, pos + to.size() ) )
+        type.replace(pos, from.size(), to);
+    };
+    replaceAll("ROOT::VecOps::RVec<", "RVec<");
+    replaceAll("ROOT::RVec<", "RVec<");
+    replaceAll("std::vector<", "vector<");
+    replaceAll("Double_t", "double");
+    replaceAll("Float_t", "float");
+    replaceAll("UInt_t", "unsignedint");
+    replaceAll("Int_t", "int");
+    replaceAll("Bool_t", "bool");
+    return type;
+  }
+
+  /**
+   * @brief Call a function with the scalar type named by a column type
+   * @param type The column type, as given by RNode::GetColumnType
+   * @param f The function, called with a TypeTag of the type
+   * @return False if the type is not a known scalar type, in which case f is
+   * not called
+   */
+  template <typename F>
+    bool visitScalarType(const std::string& type, F&& f)
+    {
+      std::string normalized = normalizeColumnType(type);
+      if (normalized == "double")
+        f(TypeTag<double>{});
+      else if (normalized == "float")
+        f(TypeTag<float>{});
+      else if (normalized == "int")
+        f(TypeTag<int>{});
+      else if (normalized == "unsignedint")
+        f(TypeTag<unsigned int>{});
+      else if (normalized == "bool")
+        f(TypeTag<bool>{});
+      else
+        return false;
+      return true;
+    }
+
+  /**
+   * @brief Call a function with the scalar or vector type named by a column
+   * type
+   * @param type The column type, as given by RNode::GetColumnType
+   * @param f The function, called with a TypeTag of the type
+   * @return False if the type is not known, in which case f is not called
+   *
+   * The vectors are ROOT::RVec and std::vector of double, float and int.
+   */
+  template <typename F>
+    bool visitColumnType(const std::string& type, F&& f)
+    {
+      if (visitScalarType(type, f) )
+        return true;
+      std::string normalized = normalizeColumnType(type);
+      if (normalized == "RVec<double>")
+        f(TypeTag<ROOT::VecOps::RVec<double>>{});
+      else if (normalized == "RVec<float>")
+        f(TypeTag<ROOT::VecOps::RVec<float>>{});
+      else if (normalized == "RVec<int>")
+        f(TypeTag<ROOT::VecOps::RVec<int>>{});
+      else if (normalized == "vector<double>")
+        f(TypeTag<std::vector<double>>{});
+      else if (normalized == "vector<float>")
+        f(TypeTag<std::vector<float>>{});
+      else if (normalized == "vector<int>")
+        f(TypeTag<std::vector<int>>{});
+      else
+        return false;
+      return true;
+    }
+
+  /// The largest number of columns read by a single packing action
+  constexpr std::size_t maxPackChunk = 8;
+
+  template <typename T, std::size_t>
+    using PackInput_t = const T&;
+
+  /// The type stored by a converter
+  template <typename Converter>
+    using packed_t = std::decay_t<decltype(
+        Converter::convert(std::declval<const typename Converter::input_t&>() ) )>;
+
+  /// Functor collecting the converted values of N columns into a vector
+  template <typename Converter, typename Seq>
+    struct PackValues;
+
+  template <typename Converter, std::size_t... I>
+    struct PackValues<Converter, std::index_sequence<I...>> {
+      ROOT::VecOps::RVec<packed_t<Converter>> operator()(
+          PackInput_t<typename Converter::input_t, I>... values) const
+      {
+        return ROOT::VecOps::RVec<packed_t<Converter>>{Converter::convert(values)...};
+      }
+    };
+
+  /// Functor appending the converted values of N columns to a vector
+  template <typename Converter, typename Seq>
+    struct AppendValues;
+
+  template <typename Converter, std::size_t... I>
+    struct AppendValues<Converter, std::index_sequence<I...>> {
+      ROOT::VecOps::RVec<packed_t<Converter>> operator()(
+          const ROOT::VecOps::RVec<packed_t<Converter>>& previous,
+          PackInput_t<typename Converter::input_t, I>... values) const
+      {
+        ROOT::VecOps::RVec<packed_t<Converter>> result;
+        result.reserve(previous.size() + sizeof...(I) );
+        result.insert(result.end(), previous.begin(), previous.end() );
+        using swallow = int[];
+        (void)swallow{0, (result.push_back(Converter::convert(values) ), 0)...};
+        return result;
+      }
+    };
+
+  template <template <typename, typename> class Action, typename Converter>
+    ROOT::RDF::RNode bookPack(
+        ROOT::RDF::RNode&,
+        const std::string&,
+        const std::vector<std::string>&,
+        std::size_t,
+        std::integral_constant<std::size_t, maxPackChunk + 1>)
+    {
+      throw std::logic_error("Too many columns for one packing action");
+    }
+
+  /// Book Action for a chunk of nValues columns
+  template <template <typename, typename> class Action, typename Converter, std::size_t N>
+    ROOT::RDF::RNode bookPack(
+        ROOT::RDF::RNode& rnode,
+        const std::string& name,
+        const std::vector<std::string>& inputs,
+        std::size_t nValues,
+        std::integral_constant<std::size_t, N>)
+    {
+      if (nValues == N)
+        return rnode.Define(
+            name, Action<Converter, std::make_index_sequence<N>>{}, inputs);
+      return bookPack<Action, Converter>(
+          rnode, name, inputs, nValues,
+          std::integral_constant<std::size_t, N + 1>{});
+    }
+
+  /**
+   * @brief Define a column holding the converted values of several columns
+   * @tparam Converter Defines the type of the columns (input_t) and how each
+   * value is stored (convert)
+   * @param rnode The RNode holding the columns, updated with the new column
+   * @param columns The columns, in the order in which they are stored
+   * @param name The name of the new column
+   *
+   * Unlike a string expression listing the columns this needs no
+   * interpreter. At most maxPackChunk columns are read by each action, longer
+   * lists are split over several actions.
+   */
+  template <typename Converter>
+    void packColumns(
+        ROOT::RDF::RNode& rnode,
+        const std::vector<std::string>& columns,
+        const std::string& name)
+    {
+      if (columns.empty() )
+        throw std::invalid_argument("No columns to pack into " + name);
+      std::string current;
+      for (std::size_t start = 0; start < columns.size(); start += maxPackChunk) {
+        std::size_t end = std::min(columns.size(), start + maxPackChunk);
+        std::vector<std::string> inputs;
+        if (start != 0)
+          inputs.push_back(current);
+        inputs.insert(inputs.end(), columns.begin() + start, columns.begin() + end);
+        current = end == columns.size() ? name : uniqueBranchName("Pack");
+        rnode = start == 0 ?
+          bookPack<PackValues, Converter>(
+              rnode, current, inputs, end - start,
+              std::integral_constant<std::size_t, 1>{}) :
+          bookPack<AppendValues, Converter>(
+              rnode, current, inputs, end - start,
+              std::integral_constant<std::size_t, 1>{});
+      }
+    }
+
+  /**
+   * @brief Pack each of a list of groups of columns into its own vector
+   * @tparam Args The types of the vectors, RVec<T> for columns of type T
+   * @param rnode The RNode holding the columns, updated with the new columns
+   * @param groups The columns to pack into each vector
+   * @return The names of the new columns
+   */
+  template <typename... Args>
+    std::vector<std::string> packEach(
+        ROOT::RDF::RNode& rnode,
+        const std::vector<std::vector<std::string>>& groups,
+        ROOT::TypeTraits::TypeList<Args...>)
+    {
+      if (groups.size() != sizeof...(Args) )
+        throw std::invalid_argument(
+            "Received " + std::to_string(groups.size() ) + " groups of "
+            "columns for " + std::to_string(sizeof...(Args) ) + " arguments");
+      std::vector<std::string> packed;
+      packed.reserve(groups.size() );
+      std::size_t idx = 0;
+      using swallow = int[];
+      (void)swallow{0, (
+          packed.push_back(uniqueBranchName("SysPack") ),
+          packColumns<Copy<typename std::decay_t<Args>::value_type>>(
+            rnode, groups.at(idx++), packed.back() ),
+          0)...};
+      return packed;
+    }
+} } //> end namespace RDFAnalysis::detail
+#endif //> !RDFAnalysis_PackColumns_H
@@ -3,10 +3,18 @@
 
 // ROOT includes
 #include <ROOT/RDF/InterfaceUtils.hxx>
+#include "RDFAnalysis/SystematicsBackend.h"
+#include "RDFAnalysis/SysHistogram.h"
+#include "RDFAnalysis/DeltaHistogram.h"
+#ifdef RDFAnalysis_HAS_VARY
+#include <ROOT/RDF/RResultMap.hxx>
+#endif
 
 // STL includes
 #include <type_traits>
 #include <functional>
+#include <memory>
+#include <string>
 
 /**
  * @file ResultWrapper.h
@@ -38,6 +46,67 @@ namespace RDFAnalysis {
           ResultWrapper(ROOT::RDF::RResultPtr<U> ptr) :
             m_holder([ptr] () mutable -> T* {return ptr.GetPtr();}) {}
 
+        /**
+         * @brief Constructor from one variation of a SysHistogram
+         * @tparam U The concrete type of the histogram
+         * @param ptr The RResultPtr to the SysHistogram
+         * @param variation The index of the variation to wrap
+         *
+         * The histogram for the variation is only created when it is first
+         * retrieved.
+         */
+        template <typename U, 
+                 typename = std::enable_if_t<std::is_base_of<T, U>{} || std::is_same<T, U>{}, void>>
+          ResultWrapper(ROOT::RDF::RResultPtr<SysHistogram<U>> ptr, std::size_t variation) :
+            m_holder([ptr, variation] () mutable -> T* {return ptr->histogram(variation);}) {}
+
+        /**
+         * @brief Constructor from a summary of a SysHistogram
+         * @tparam U The concrete type of the histogram
+         * @param ptr The RResultPtr to the SysHistogram
+         * @param which The summary to wrap
+         *
+         * The summary is only created when it is first retrieved.
+         */
+        template <typename U, 
+                 typename = std::enable_if_t<std::is_base_of<T, U>{} || std::is_same<T, U>{}, void>>
+          ResultWrapper(ROOT::RDF::RResultPtr<SysHistogram<U>> ptr, SysSummary which) :
+            m_holder([ptr, which] () mutable -> T* {return ptr->summary(which);}) {}
+
+        /**
+         * @brief Constructor from one variation of a DeltaHistogram
+         * @tparam U The concrete type of the histogram
+         * @param ptr The RResultPtr to the DeltaHistogram
+         * @param nominal The nominal histogram the differences apply to
+         * @param variation The index of the variation to wrap
+         *
+         * The histogram for the variation is only created when it is first
+         * retrieved.
+         */
+        template <typename U, 
+                 typename = std::enable_if_t<std::is_base_of<T, U>{} || std::is_same<T, U>{}, void>>
+          ResultWrapper(
+              ROOT::RDF::RResultPtr<DeltaHistogram<U>> ptr,
+              ResultWrapper<U> nominal,
+              std::size_t variation) :
+            m_holder([ptr, nominal, variation] () mutable -> T* {
+                return ptr->histogram(variation, *nominal.get() );}) {}
+
+#ifdef RDFAnalysis_HAS_VARY
+        /**
+         * @brief Constructor from one entry of a map of varied results
+         * @tparam U The concrete type of the varied results
+         * @param map The varied results, shared between all of their wrappers
+         * @param key The key of the variation to wrap
+         */
+        template <typename U, 
+                 typename = std::enable_if_t<std::is_base_of<T, U>{} || std::is_same<T, U>{}, void>>
+          ResultWrapper(
+              std::shared_ptr<ROOT::RDF::Experimental::RResultMap<U>> map,
+              const std::string& key) :
+            m_holder([map, key] () -> T* {return &(*map)[key];}) {}
+#endif
+
         /**
          * @brief Copy constructor
          * @tparam U The held type of the other object
@@ -27,11 +27,15 @@ namespace RDFAnalysis {
        * @param other The namer to copy from.
        */
       ScheduleNamer(const IBranchNamer& other) :
-        m_branches(other.branches() ),
-        m_nominal("") {}
+        m_branches(other.branches() ) {}
 
       ~ScheduleNamer() {}
 
+      using IBranchNamer::nameBranch;
+      using IBranchNamer::createBranch;
+      using IBranchNamer::exists;
+      using IBranchNamer::affectingMask;
+
       /**
        * @brief Get the full name of a branch
        * @param branch The base name of the branch
@@ -41,7 +45,7 @@ namespace RDFAnalysis {
        */
       std::string nameBranch(
           const std::string& branch,
-          const std::string& = "") const override { return branch; }
+          SysID_t) const override { return branch; }
 
       /**
        * @brief Create a new branch
@@ -49,7 +53,7 @@ namespace RDFAnalysis {
        */
       std::string createBranch(
           const std::string& branch,
-          const std::string& = "") override
+          SysID_t) override
       { 
         m_branches.push_back(branch);
         return branch;
@@ -61,23 +65,15 @@ namespace RDFAnalysis {
        */
       bool exists(
           const std::string& branch,
-          const std::string& = "") const override
+          SysID_t) const override
       { return std::count(m_branches.begin(), m_branches.end(), branch) > 0; }
 
-      const std::string& nominalName() const override { return m_nominal;}
-
-      /**
-       * @brief Get all systematics.
-       */
-      std::vector<std::string> systematics() const override
-      { return std::vector<std::string>{}; }
-
       /**
        * @brief Get all systematics affecting a base branch name.
        */
-      std::set<std::string> systematicsAffecting(
-          const std::string& = "") const override
-      { return std::set<std::string>{}; }
+      SystematicMask affectingMask(
+          const std::string&) const override
+      { return SystematicMask{}; }
 
       /**
        * @brief Get all branch base names
@@ -89,7 +85,7 @@ namespace RDFAnalysis {
        * @brief Read branch lists from a set of rnodes
        */
       void readBranchList(
-          const std::map<std::string, ROOT::RDF::RNode>&) override {}
+          const std::map<SysID_t, ROOT::RDF::RNode>&) override {}
 
       /// Make a copy of this class
       std::unique_ptr<IBranchNamer> copy() const override
@@ -98,8 +94,6 @@ namespace RDFAnalysis {
     private:
       /// The branches
       std::vector<std::string> m_branches;
-      /// The (dummy) nominal systematic
-      std::string m_nominal;
 
   }; //> end class ScheduleNamer
 } //> end namespace RDFAnalysis
@@ -3,8 +3,10 @@
 
 // Package includes
 #include "RDFAnalysis/Node.h"
+#include "RDFAnalysis/CompiledExpression.h"
 #include "RDFAnalysis/SchedulerBase.h"
 #include "RDFAnalysis/ScheduleNamer.h"
+#include "RDFAnalysis/TimedCallable.h"
 
 /**
  * @file Node.h
@@ -42,9 +44,65 @@ namespace RDFAnalysis {
         /**
          * @brief Schedule the analysis
          * @param graphFile If set, write the schedule to this file.
+         * @exception std::logic_error if an update attaches new actions to a
+         * node that was built without variations that they need
+         *
+         * If the analysis has already been scheduled then only the regions and
+         * fills added since are scheduled. These are spliced into the existing
+         * schedule and node tree so only the new Define, Filter and Fill calls
+         * are made. Filters shared between regions are only built with the
+         * variations that their regions needed at the time, so a new region
+         * needing more variations cannot be attached below them.
          */
         ScheduleNode& schedule(const std::string& graphFile = "");
 
+        /**
+         * @brief Calibrate the costs of the filters and variables
+         * @param nEntries The number of entries to run the calibration over
+         * @param costFile If set, costs are read from this file if it matches
+         * the registered actions. Otherwise the calibration is run and the
+         * result written to it.
+         * @exception std::logic_error if the analysis has already been
+         * scheduled
+         *
+         * The analysis is scheduled with the current costs and run over the
+         * first nEntries entries on a separate node tree. The time per call of
+         * each action and the fraction of entries passing each filter are
+         * measured. Variables get their time per call in microseconds as a cost
+         * and filters get their time per call divided by the fraction of
+         * entries that they reject, so the filters that remove the most entries
+         * for the least time are applied first. The pass fractions are also
+         * recorded for use by the filter order optimisation.
+         *
+         * Only actions defined from functors can be timed. Filters defined from
+         * string expressions are given the average time of the timed filters
+         * (or one microsecond if there are none). Actions that are never
+         * called during the calibration keep their current cost.
+         *
+         * The calibration uses RNode::Range so must be run before implicit
+         * multithreading is enabled.
+         */
+        void calibrate(ULong64_t nEntries, const std::string& costFile = "");
+
+        /**
+         * @brief Prune unused systematic variations after scheduling
+         * @param prune Whether or not to prune
+         * @param keepCutflows Whether nodes in the cutflow keep their
+         * variations
+         *
+         * If set, schedule ends by calling Node::pruneVariations on the root
+         * node and reports how many RNodes were avoided for each systematic.
+         * Variations pruned in this way cannot be rebuilt, so a later update
+         * of the schedule that needs one of them throws std::logic_error.
+         * Register everything before the first call to schedule if the
+         * analysis is extended afterwards.
+         */
+        void setVariationPruning(bool prune, bool keepCutflows = true)
+        {
+          m_pruneVariations = prune;
+          m_pruneKeepsCutflows = keepCutflows;
+        }
+
         /// Helper struct to define a region
         struct Region {
           /// The node that defines the final selection of this region
@@ -103,6 +161,27 @@ namespace RDFAnalysis {
               const std::set<std::string>& filters = {},
               float cost = 0);
 
+        /**
+         * @brief Register a new variable definition that evaluates all of its
+         * systematic variations in one call
+         * @tparam F The functor type
+         * @param name The name of the column to define
+         * @param f The functor
+         * @param columns The input variables to the functor
+         * @param filters Any filters that this depends on
+         * @param cost A cost estimate for this action
+         *
+         * The variable is defined with NodeBase::DefineSys, see there for the
+         * form the functor should take.
+         */
+        template <typename F>
+          void registerVariableSys(
+              const std::string& name, 
+              F f,
+              const ColumnNames_t& columns,
+              const std::set<std::string>& filters = {},
+              float cost = 0);
+
         /**
          * @brief Register a new variable definition
          * @param name The name of the column to define
@@ -197,8 +276,13 @@ namespace RDFAnalysis {
        * @param filters The filters that this depends on
        * @param cost The estimated cost of this action
        *
+       * @param weightOnlyColumns Any of the columns that only influence the
+       * weight
+       *
        * In this overload the functor calculates the pass decision and the
-       * weight in one go, return std::make_tuple(pass, weight).
+       * weight in one go, return std::make_tuple(pass, weight). Systematics
+       * that only affect weightOnlyColumns do not split the tree, see
+       * Node::Filter.
        */
       template <typename F>
         std::enable_if_t<std::is_convertible<typename ROOT::TTraits::CallableTraits<F>::ret_type, std::tuple<bool, float>>::value, void> registerFilter(
@@ -208,7 +292,8 @@ namespace RDFAnalysis {
             const std::string& cutflowName = "",
             WeightStrategy strategy = WeightStrategy::Default,
             const std::set<std::string>& filters = {},
-            float cost = 0);
+            float cost = 0,
+            const ColumnNames_t& weightOnlyColumns = {});
 
       /**
        * @brief Register a new filter
@@ -233,6 +318,33 @@ namespace RDFAnalysis {
             const std::set<std::string>& filters = {},
             float cost = 0);
 
+      /**
+       * @brief Register a new filter that evaluates all of its systematic
+       * variations in one call
+       * @tparam F The functor type
+       * @param f The functor
+       * @param columns The input variables to the functor
+       * @param name The name of both the new filter and the node it creates
+       * @param cutflowName How the new node appears in the cutflow
+       * @param weight Expression to calculate the node weight
+       * @param strategy Weighting strategy for this weight
+       * @param filters The filters that this depends on 
+       * @param cost The estimated cost of this action
+       *
+       * The filter is created with Node::FilterSys, see there for the form
+       * the functor should take.
+       */
+      template <typename F>
+        void registerFilterSys(
+            F f,
+            const ColumnNames_t& columns,
+            const std::string& name,
+            const std::string& cutflowName = "",
+            const std::string& weight = "",
+            WeightStrategy strategy = WeightStrategy::Default,
+            const std::set<std::string>& filters = {},
+            float cost = 0);
+
       /**
        * @brief Register a new filter
        * @param expression The expression to describe the filter
@@ -326,6 +438,11 @@ namespace RDFAnalysis {
        * @param strategy The weight strategy to use
        * @param filters The filters that this depends on
        *
+       * RDataFrame works out the types of the columns with the interpreter
+       * when the fill is booked. An analysis that must run without the
+       * interpreter (see writeCompiledExpressions) has to use the overload
+       * taking the column types instead.
+       *
        * Note that right now this won't work if T doesn't inherit from TH1. TODO
        * fix this! 
        */
@@ -337,6 +454,29 @@ namespace RDFAnalysis {
             WeightStrategy strategy = WeightStrategy::Default,
             const std::set<std::string>& filters = {});
 
+      /**
+       * @brief register a new fill, giving the types of its columns
+       * @tparam ColType The type of the first column
+       * @tparam ColTypes The types of the other columns
+       * @tparam T The type of object to be filled.
+       * @param model The 'model' object to fill.
+       * @param columns The columns to use for the object's Fill method.
+       * @param weight The column containing the weight information
+       * @param strategy The weight strategy to use
+       * @param filters The filters that this depends on
+       *
+       * The fill is booked using the typed NodeBase::Fill, avoiding the
+       * interpreter as long as the weight is a double or float column.
+       */
+      template <typename ColType, typename... ColTypes, typename T,
+               typename = std::enable_if_t<!std::is_same<ColType, T>::value>>
+        void registerFill(
+            const T& model,
+            const ColumnNames_t& columns,
+            const std::string& weight = "",
+            WeightStrategy strategy = WeightStrategy::Default,
+            const std::set<std::string>& filters = {});
+
       protected:
         /// The defined filters
         std::map<std::string, std::function<node_t*(node_t*)>> m_filters;
@@ -351,10 +491,91 @@ namespace RDFAnalysis {
         /// After scheduling, pointers to the end nodes for all defined regions
         /// will be here
         std::map<std::string, Region> m_regions;
+        /// Record of the node created for each node of the schedule
+        struct BuiltNode {
+          /// The node after the action has been applied
+          node_t* node;
+          /// The region that any children belong to
+          std::string region;
+          /// The children, in the same order as in the schedule
+          std::vector<BuiltNode> children;
+        }; //> end struct BuiltNode
+        /// The nodes created for the schedule. The node is null if schedule
+        /// has not been called.
+        BuiltNode m_built{nullptr, "", {}};
         /// Copy information across from the Schedule node to the actual node
         void addNode(const ScheduleNode& source, 
                      node_t* target,
-                     const std::string& currentRegion = "");
+                     const std::string& currentRegion,
+                     BuiltNode& built);
+        /**
+         * @brief The systematics needed by the regions at or below a node of
+         * the schedule
+         * @param source The node of the schedule
+         * @param currentRegion The region that the node's parent belongs to
+         */
+        SystematicMask regionSystematics(
+            const ScheduleNode& source,
+            const std::string& currentRegion) const;
+        /**
+         * @brief The systematics affecting the columns read by a node of the
+         * schedule and everything below it
+         * @param source The node of the schedule
+         * @param namer The namer of the node that source is attached to
+         */
+        SystematicMask subtreeSystematics(
+            const ScheduleNode& source,
+            const IBranchNamer& namer) const;
+        /**
+         * @brief The systematics affecting the columns read by an action
+         * @param action The action
+         * @param namer The namer of the node that the action is applied to
+         *
+         * Variables that the namer does not know yet are followed through to
+         * their own inputs.
+         */
+        SystematicMask actionSystematics(
+            const Action& action,
+            const IBranchNamer& namer) const;
+        /// Add the changes from an incremental update to the node tree
+        void applyUpdate(const ScheduleUpdate& update);
+        /// Whether to prune unused variations after scheduling
+        bool m_pruneVariations{false};
+        /// Whether nodes in the cutflow keep their variations when pruning
+        bool m_pruneKeepsCutflows{true};
+        /// Prune unused variations, if requested
+        void pruneVariations();
+        /// Expression templates of the registered string variables
+        std::vector<detail::ExpressionRequest> m_expressionTemplates;
+        /// Registered string expressions, with whether they are filters, that
+        /// are only expanded when the analysis is scheduled
+        std::vector<std::pair<bool, std::string>> m_stringExpressions;
+        /**
+         * @brief Compile the registered string expressions together
+         *
+         * Only the expressions whose inputs are all defined on the root node
+         * are compiled, the others are compiled when they are used.
+         */
+        void compileExpressions();
+        /// Timed versions of the variables defined from functors
+        std::map<std::string, std::function<void(node_t*)>> m_timedVariables;
+        /// Timed versions of the filters defined from functors
+        std::map<std::string, std::function<node_t*(node_t*)>> m_timedFilters;
+        /// The profiles filled by the timed actions
+        std::map<Action, std::shared_ptr<ActionProfile>> m_profiles;
+        /// Wrap a functor so that its calls are recorded in the action's
+        /// profile
+        template <typename F>
+          detail::TimedCallable<F> timed(const Action& action, F f);
+        /// The filter counts recorded during a calibration. For each filter
+        /// the number of entries before and after it, for each place it occurs
+        using CalibrationCounts = std::map<std::string, std::vector<std::pair<
+          ROOT::RDF::RResultPtr<ULong64_t>, ROOT::RDF::RResultPtr<ULong64_t>>>>;
+        /// Copy a node of the schedule across to the calibration tree
+        void addCalibrationNode(
+            const ScheduleNode& source,
+            node_t* target,
+            CalibrationCounts& counts);
     }; //> end class Scheduler
 } //> end namespace RDFAnalysis
 #include "RDFAnalysis/Scheduler.icc"
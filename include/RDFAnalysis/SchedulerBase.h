@@ -3,10 +3,15 @@
 
 #include "RDFAnalysis/IBranchNamer.h"
 
+#include <boost/dynamic_bitset.hpp>
+
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <map>
 #include <set>
 #include <vector>
+#include <unordered_map>
 
 namespace RDFAnalysis {
   /**
@@ -40,6 +45,33 @@ namespace RDFAnalysis {
         std::set<std::string> fills;
         /// Add a fill to the region
         void addFill(const std::string& fill) {fills.insert(fill); }
+        /// Whether only the allowed systematics are built for the region
+        bool restrictSystematics = false;
+        /// The systematics built for the region, if restrictSystematics is set
+        std::set<std::string> allowedSystematics;
+        /// Systematics never built for the region
+        std::set<std::string> deniedSystematics;
+        /**
+         * @brief Only build the nominal and these systematics for the region
+         *
+         * Can be called several times to extend the list.
+         */
+        void allowSystematics(const std::set<std::string>& systematics)
+        {
+          restrictSystematics = true;
+          allowedSystematics.insert(systematics.begin(), systematics.end() );
+        }
+        /// Never build these systematics for the region
+        void denySystematics(const std::set<std::string>& systematics)
+        { deniedSystematics.insert(systematics.begin(), systematics.end() ); }
+        /**
+         * @brief The systematics that the region needs
+         * @param registry The registry holding the systematic IDs
+         *
+         * Names that are not registered are ignored. The nominal is always
+         * included.
+         */
+        SystematicMask systematicsMask(const SystematicRegistry& registry) const;
       }; //> end struct RegionDef
 
       /**
@@ -70,11 +102,20 @@ namespace RDFAnalysis {
        * For example, x == 4 clearly satisfies the filter x > 2 so any action
        * that depends on this selection does not need to sequence 'x > 2' if 'x
        * == 4' has already been scheduled.
+       *
+       * Relations between simple threshold filters defined from string
+       * expressions are inferred automatically, see inferFilterSatisfaction.
        */
       void filterSatisfies(
           const std::string& filter,
           const std::vector<std::string>& satisfied);
 
+      /// The index of an action in the interned action table
+      using ActionID_t = std::size_t;
+
+      /// Returned when an action is not in the action table
+      static constexpr ActionID_t noAction = static_cast<ActionID_t>(-1);
+
       /**
        * @brief Helper struct to represent all the information that the
        * scheduler needs to know about an action in order to form the ordering.
@@ -114,76 +155,27 @@ namespace RDFAnalysis {
           }
         }; //> end struct CostOrdering
 
-        /**
-         * @brief Expand the dependencies of this action
-         * @param scheduler The scheduler instance to use
-         * @param preExisting Any actions that already exist by the point in the
-         * schedule in which this action is to be inserted
-         * @exception std::runtime_error if a circular dependency is found
-         * @return A map of this action and all its direct and indirect
-         * dependencies to their direct dependencies
-         */
-        std::map<Action, std::set<Action>, CostOrdering> expand(
-            const SchedulerBase& scheduler,
-            const std::set<Action>& preExisting = {}) const;
-        /**
-         * @brief Expand the dependencies of this action
-         * @param scheduler The scheduler instance to use
-         * @param preExisting Any actions that already exist by the point in the
-         * schedule in which this action is to be inserted
-         * @param processing A list of the actions currently being processed.
-         * This is used to catch circular dependencies that would otherwise
-         * cause an infinite loop
-         * @exception std::runtime_error if a circular dependency is found
-         * @return A map of this action and all its direct and indirect
-         * dependencies to their direct dependencies
-         */
-        std::map<Action, std::set<Action>, CostOrdering> expand(
-            const SchedulerBase& scheduler,
-            const std::set<Action>& preExisting,
-            std::vector<Action>& processing) const;
-
         /// Get the cost of this action from the scheduler
         void retrieveCost(const SchedulerBase& scheduler);
       }; //> end struct Action
 
       /**
-       * @brief Helper struct used to build and express the schedule.
+       * @brief Helper struct used to express the schedule.
        *
-       * Each node performs one action. When building the raw schedule, each
-       * node is loaded with its dependencies which are then expanded in the
-       * full schedule.
+       * Each node performs one action. While the schedule is being built the
+       * scheduler works with the interned action IDs, the nodes are only
+       * created once each action's position is fixed.
        */
       struct ScheduleNode {
         /// Build the node from the action it performs
         ScheduleNode(const Action& action) : action(action) {}
         /// The action performed by this node
         Action action;
-        /// The dependencies of that action
-        std::map<Action, std::set<Action>, Action::CostOrdering> dependencies;
         /// The children of this node (i.e. the ones that follow it)
         std::vector<ScheduleNode> children;
         /// The region, if any, that this node defines (i.e. is the final action
         /// listed for that region)
         std::string region;
-
-        /**
-         * @brief Get the next dependency from this action. This is defined as
-         * the 'smallest' action (using Action::CostOrdering) that has no
-         * remaining dependencies
-         * @exception std::out_of_range If no such dependency exists. This is a
-         * logic error as it should be impossible to occur.
-         */
-        const Action& next() const;
-
-        /// Remove a dependency from consideration
-        void removeDependency(Action action, const SchedulerBase& scheduler);
-
-        /// Expand this node's dependencies
-        void expand(
-            const SchedulerBase& scheduler,
-            const std::set<Action>& preExisting = {})
-        { dependencies = action.expand(scheduler, preExisting); }
       }; //> end struct ScheduleNode
 
       /**
@@ -204,6 +196,106 @@ namespace RDFAnalysis {
       /// not been called.
       const std::vector<std::string>& usedVariables() const { return m_usedVars; }
 
+      /**
+       * @brief Persist the schedule between jobs
+       * @param fileName The file to store the schedule in. If empty (the
+       * default) the schedule is always built from scratch.
+       *
+       * When this is set, schedule first calculates the configuration hash. If
+       * the file contains a schedule with the same hash then that schedule is
+       * used directly, otherwise the schedule is built as normal and written to
+       * the file.
+       */
+      void setScheduleFile(const std::string& fileName)
+      { m_scheduleFile = fileName; }
+
+      /// The file used to persist the schedule
+      const std::string& scheduleFile() const { return m_scheduleFile; }
+
+      /**
+       * @brief Calculate a hash of everything that determines the schedule
+       * @param namer IBranchNamer that provides the list of predefined
+       * variables.
+       *
+       * This covers the registered actions and their costs, the satisfaction
+       * relations, the regions, the predefined variables and any variables used
+       * by an earlier call to schedule. The hash does not depend on the
+       * platform or the build, so it can be compared between jobs.
+       */
+      std::uint64_t configurationHash(const IBranchNamer& namer) const;
+
+      /**
+       * @brief Set the number of threads used to build the schedule
+       * @param nThreads The maximum number of threads to use. 0 or 1 means that
+       * the schedule is built serially.
+       *
+       * When more than one thread is allowed, the subtrees below each branching
+       * point of the schedule are built concurrently. The result is always
+       * identical to the serial schedule.
+       */
+      void setSchedulingThreads(std::size_t nThreads)
+      { m_schedulingThreads = nThreads; }
+
+      /// The maximum number of threads used to build the schedule
+      std::size_t schedulingThreads() const { return m_schedulingThreads; }
+
+      /**
+       * @brief Allow the filters within each region to be reordered
+       * @param optimize Whether to optimise the filter order
+       *
+       * By default regions are only merged while their filter lists share an
+       * identical prefix. When this is enabled the filters of each region may
+       * be reordered, while still respecting the dependencies between them, so
+       * that the regions share as many filters as possible. The order is
+       * chosen to minimise the estimated number of filter evaluations per
+       * entry, with the filter costs used to decide between orders with the
+       * same estimate. Small configurations are searched exhaustively and
+       * larger ones greedily.
+       *
+       * Regions with the same set of filters as another region are left as
+       * they are. Note that a region added after schedule has been called can
+       * still be reported as identical to a scheduled region with the same
+       * filters if that region's filters were reordered.
+       */
+      void setFilterOrderOptimization(bool optimize)
+      { m_optimizeFilterOrder = optimize; }
+
+      /// Whether the filters within each region may be reordered
+      bool filterOrderOptimization() const { return m_optimizeFilterOrder; }
+
+      /**
+       * @brief Set the fraction of entries expected to pass a filter
+       * @param filter The name of the filter
+       * @param fraction The pass fraction, between 0 and 1
+       * @exception std::out_of_range if the fraction is outside [0, 1]
+       */
+      void setPassFraction(const std::string& filter, float fraction);
+
+      /// The fraction of entries expected to pass a filter. This is 1 unless
+      /// it has been set.
+      float passFraction(const std::string& filter) const;
+
+      /**
+       * @brief Estimate the number of filter evaluations per entry needed for
+       * a set of regions
+       * @param regionDefs The regions to estimate
+       *
+       * The regions are merged where their filter lists share a prefix and
+       * each filter is counted with the fraction of entries that pass the
+       * filters before it.
+       */
+      double estimatedFilterEvaluations(
+          const std::map<std::string, RegionDef>& regionDefs) const;
+
+      /**
+       * @brief Reorder the filters of a set of regions to minimise the
+       * estimated filter evaluations
+       * @param regionDefs The regions to reorder
+       * @return The reordered regions
+       */
+      std::map<std::string, RegionDef> optimizedRegionDefs(
+          const std::map<std::string, RegionDef>& regionDefs) const;
+
       /**
        * @brief Get the dependency corresponding to an action.
        * @exception std::out_of_range if the action is unknown
@@ -216,6 +308,34 @@ namespace RDFAnalysis {
        */
       float getCost(const Action& action) const;
 
+      /**
+       * @brief Set the cost of an action
+       * @param action The action to change
+       * @param cost The new cost
+       * @exception std::out_of_range if the action is unknown
+       */
+      void setCost(const Action& action, float cost);
+
+      /**
+       * @brief Write the costs of all registered actions to a file
+       * @param fileName The file to write
+       *
+       * The file is keyed by a hash of the registered actions and their
+       * dependencies (but not their costs) so that readCosts ignores it once
+       * the actions change.
+       */
+      void writeCosts(const std::string& fileName) const;
+
+      /**
+       * @brief Set the costs of the registered actions from a file written by
+       * writeCosts
+       * @param fileName The file to read
+       * @return Whether the costs were read. This is false if the file does
+       * not exist or was written for a different set of actions, in which case
+       * no costs are changed.
+       */
+      bool readCosts(const std::string& fileName);
+
       /**
        * @brief Check whether an action has already been satisfied by one of a
        * list of candidates.
@@ -244,6 +364,18 @@ namespace RDFAnalysis {
           const std::set<Action>& candidates,
           Action& satisfiedBy,
           bool considerSelf = true) const;
+
+      /**
+       * @brief Check whether an action is satisfied by a single candidate.
+       * @param action The action to check for
+       * @param candidate The candidate that could have satisfied it
+       * @param considerSelf Whether or not to count action satisfied if it is
+       * the candidate
+       */
+      bool isActionSatisfiedBy(
+          const Action& action,
+          const Action& candidate,
+          bool considerSelf = true) const;
     protected:
 
       /**
@@ -257,17 +389,26 @@ namespace RDFAnalysis {
           const std::set<Action>& dependencies);
 
       /**
-       * @brief Look through a list of filters for any that satisfy each other
+       * @brief Infer the satisfaction relations for a filter defined from a
+       * string expression
+       * @param filter The name of the filter
+       * @param expression The expression with its columns replaced by
+       * placeholders, as returned by IBranchNamer::expandExpression
+       * @param columns The columns that the placeholders refer to
+       * @param weighted Whether the filter applies a weight
        *
-       * Imagine an action that ends up with the dependencies (writing filters
-       * only) {pT > 100, n_B > 1, n_B > 2}. Clearly running both of the n_B
-       * selections is wasteful, and if scale factors are applied as part of
-       * those selections it might well be actively harmful. Given this set of
-       * inputs the return value of this function would be
-       * {n_B > 1 : n_B > 2}
+       * Expressions that are a conjunction (&&) of comparisons (<, <=, >, >=,
+       * ==) between a single column and a number are understood. Each such
+       * filter is compared to the others and where one accepts a strict subset
+       * of the values that another accepts it is recorded as satisfying it.
+       * Filters that apply a weight are never marked as satisfied as their
+       * weight would then be lost.
        */
-      std::map<Action, Action> buildReplacementMap(
-          const std::set<Action>& filters) const;
+      void inferFilterSatisfaction(
+          const std::string& filter,
+          const std::string& expression,
+          const std::vector<std::string>& columns,
+          bool weighted);
 
       /**
        * @brief Tell the scheduler that an action is defining multiple variables
@@ -287,6 +428,20 @@ namespace RDFAnalysis {
       ScheduleNode& schedule(const IBranchNamer& namer);
 
 
+      /**
+       * @brief Build the schedule without storing it
+       * @param namer IBranchNamer that provides the list of predefined
+       * variables.
+       * @param[out] usedVariables The variables used by the schedule, in the
+       * order in which they must be defined
+       * @return The root node of the new schedule
+       *
+       * Neither the stored schedule nor its used variables are affected.
+       */
+      ScheduleNode buildDetachedSchedule(
+          const IBranchNamer& namer,
+          std::vector<std::string>& usedVariables);
+
       /**
        * @brief Build the 'raw' schedule
        * @return The root node of the raw schedule
@@ -295,11 +450,324 @@ namespace RDFAnalysis {
        */
       ScheduleNode rawSchedule() const;
 
+      /**
+       * @brief Get the regions in the form in which they should be scheduled
+       * @param regionDefs The regions to schedule
+       *
+       * Threshold filters implied by an earlier filter in the same region are
+       * removed. If filter order optimisation is enabled the filters are then
+       * reordered and the estimated filter evaluations before and after are
+       * printed.
+       */
+      std::map<std::string, RegionDef> regionsToSchedule(
+          const std::map<std::string, RegionDef>& regionDefs) const;
+
+      /**
+       * @brief Build the 'raw' schedule for a subset of the regions
+       * @param regionDefs The regions to use
+       * @return The root node of the raw schedule
+       */
+      ScheduleNode rawSchedule(
+          const std::map<std::string, RegionDef>& regionDefs) const;
+
+      /**
+       * @brief Describes the changes made by updateSchedule
+       *
+       * Nodes of the schedule are identified by their path, the indices of the
+       * children to follow starting from the root node.
+       */
+      struct ScheduleUpdate {
+        /// New nodes, each of which is the root of a new subtree. They are
+        /// listed in the order in which they were added to their parents.
+        std::vector<std::vector<std::size_t>> newNodes;
+        /// Existing nodes that now define a region
+        std::vector<std::vector<std::size_t>> newRegions;
+        /// Variables used for the first time by the new nodes, in the order in
+        /// which they must be defined
+        std::vector<std::string> newVariables;
+      }; //> end struct ScheduleUpdate
+
+      /**
+       * @brief Add any regions and fills defined since the last call to
+       * schedule or updateSchedule to the existing schedule
+       * @param namer IBranchNamer that provides the list of predefined
+       * variables.
+       * @return The changes made to the schedule
+       *
+       * The new regions are scheduled on their own and the result is merged
+       * into the existing schedule. Wherever the new schedule follows the
+       * same actions as the existing one the existing nodes are reused.
+       */
+      ScheduleUpdate updateSchedule(const IBranchNamer& namer);
+
     private:
+      /**
+       * @brief The dependency information for one action in a node of the
+       * schedule that is being built
+       */
+      struct DependencyEntry {
+        /// The action
+        ActionID_t action;
+        /// Its remaining direct dependencies, sorted by ID
+        std::vector<ActionID_t> dependencies;
+      }; //> end struct DependencyEntry
+
+      /// An action and all of its direct and indirect dependencies, sorted by
+      /// the cost ordering of the actions
+      using DependencyList = std::vector<DependencyEntry>;
+
+      /**
+       * @brief A node of the schedule while it is being built
+       *
+       * Each node is loaded with the expanded dependencies of its action, which
+       * are removed one by one as they are added to the full schedule.
+       */
+      struct PendingNode {
+        /// Build the node from the action it performs
+        PendingNode(ActionID_t action) : action(action) {}
+        /// The action performed by this node
+        ActionID_t action;
+        /// The dependencies of that action
+        DependencyList dependencies;
+        /// The children of this node (i.e. the ones that follow it)
+        std::vector<PendingNode> children;
+        /// The region, if any, that this node defines
+        std::string region;
+
+        /**
+         * @brief Get the next dependency from this action. This is defined as
+         * the 'smallest' action (using the cost ordering) that has no remaining
+         * dependencies
+         * @exception std::out_of_range If no such dependency exists. This is a
+         * logic error as it should be impossible to occur.
+         */
+        ActionID_t next(const SchedulerBase& scheduler) const;
+
+        /// Remove a dependency from consideration
+        void removeDependency(ActionID_t action, const SchedulerBase& scheduler);
+      }; //> end struct PendingNode
+
+      /**
+       * @brief Memoised action expansions for one set of pre-existing actions
+       *
+       * The result of expanding an action depends only on the action and on
+       * the actions that already exist at that point in the schedule so it can
+       * be reused for as long as that set doesn't change.
+       */
+      struct ExpansionCache {
+        /// Create the cache for a set of pre-existing actions
+        ExpansionCache(const boost::dynamic_bitset<>& preExisting) :
+          preExisting(preExisting) {}
+        /// The pre-existing actions
+        boost::dynamic_bitset<> preExisting;
+        /// The expansions calculated so far, keyed by the unexpanded action
+        std::unordered_map<ActionID_t, DependencyList> expanded;
+      }; //> end struct ExpansionCache
+
+      /// Expansion caches, keyed by a hash of their pre-existing actions
+      using ExpansionCacheStore =
+        std::unordered_multimap<std::size_t, ExpansionCache>;
+
+      /**
+       * @brief The state belonging to one thread while building the schedule
+       *
+       * A thread building a subtree speculatively starts from a snapshot of
+       * the used variables. Its newly used variables are merged back in the
+       * serial order once every subtree before it has finished.
+       */
+      struct SchedulingState {
+        /// Create the state from the variables used so far
+        SchedulingState(
+            const boost::dynamic_bitset<>& usedVars,
+            std::atomic<std::size_t>* freeWorkers) :
+          usedVars(usedVars), freeWorkers(freeWorkers) {}
+        /// All variables used so far
+        boost::dynamic_bitset<> usedVars;
+        /// The variables first used by this thread, in order
+        std::vector<ActionID_t> newVars;
+        /// The memoised expansions
+        ExpansionCacheStore caches;
+        /// The number of threads that may still be started
+        std::atomic<std::size_t>* freeWorkers;
+
+        /// Mark a variable as used
+        void useVariable(ActionID_t id);
+        /// Try to reserve a new thread
+        bool acquireWorker();
+        /// Return a thread to the pool
+        void releaseWorker() { ++*freeWorkers; }
+      }; //> end struct SchedulingState
+
+      /**
+       * @brief Expand the dependencies of an action
+       * @param action The action to expand
+       * @param cache The memoised expansions for the actions that already exist
+       * by the point in the schedule in which this action is to be inserted
+       * @param processing A list of the actions currently being processed.
+       * This is used to catch circular dependencies that would otherwise cause
+       * an infinite loop
+       * @exception std::runtime_error if a circular dependency is found
+       * @return The action and all its direct and indirect dependencies with
+       * their direct dependencies
+       */
+      const DependencyList& expand(
+          ActionID_t action,
+          ExpansionCache& cache,
+          std::vector<ActionID_t>& processing) const;
+
+      /// Get (or create) the expansion cache for a set of pre-existing actions
+      static ExpansionCache& expansionCache(
+          ExpansionCacheStore& store,
+          const boost::dynamic_bitset<>& preExisting);
+
+      /**
+       * @brief Look through a list of filters for any that satisfy each other
+       *
+       * Imagine an action that ends up with the dependencies (writing filters
+       * only) {pT > 100, n_B > 1, n_B > 2}. Clearly running both of the n_B
+       * selections is wasteful, and if scale factors are applied as part of
+       * those selections it might well be actively harmful. Given this set of
+       * inputs the return value of this function would be
+       * {n_B > 1 : n_B > 2}
+       */
+      std::map<ActionID_t, ActionID_t> buildReplacementMap(
+          const boost::dynamic_bitset<>& filters) const;
+
+      /**
+       * @brief Build the interned action table
+       *
+       * Every action known to the scheduler is given an ID. IDs are assigned
+       * in the same order as a std::set<Action> so comparing IDs is equivalent
+       * to comparing the actions. The dependencies and satisfaction relations
+       * are then converted to use these IDs.
+       *
+       * This is done at the start of schedule, or whenever a query is made
+       * after the registered actions have changed.
+       */
+      void buildActionTable() const;
+
+      /// Get the ID of an action, or noAction if it is not in the table
+      ActionID_t findAction(const Action& action) const;
+
+      /// Whether an action is satisfied by a single candidate
+      bool isSatisfiedBy(
+          ActionID_t action,
+          ActionID_t candidate,
+          bool considerSelf = true) const;
+
+      /**
+       * @brief Find the first of a set of candidates that satisfies an action
+       * @return The satisfying action or noAction if there is none
+       */
+      ActionID_t firstSatisfiedBy(
+          ActionID_t action,
+          const boost::dynamic_bitset<>& candidates,
+          bool considerSelf = true) const;
+
+      /**
+       * @brief Build a schedule from scratch
+       * @param namer IBranchNamer that provides the list of predefined
+       * variables.
+       * @param rawRoot The root node of the raw schedule
+       * @param target The node to add the schedule to
+       */
+      void buildSchedule(
+          const IBranchNamer& namer,
+          ScheduleNode&& rawRoot,
+          ScheduleNode& target);
+
+      /**
+       * @brief Merge a new schedule into an existing one
+       * @param source The node of the new schedule
+       * @param target The matching node of the existing schedule
+       * @param path The path to the target node
+       * @param update Record of the changes made
+       */
+      void mergeSchedule(
+          ScheduleNode&& source,
+          ScheduleNode& target,
+          std::vector<std::size_t>& path,
+          ScheduleUpdate& update);
+
+      /**
+       * @brief Write the schedule to file
+       * @param fileName The file to write
+       * @param hash The configuration hash
+       * @param firstChild The first child of the root node built by this call
+       * @param firstVariable The first used variable added by this call
+       * @param buildTime The time taken to build the schedule in seconds
+       */
+      void writeSchedule(
+          const std::string& fileName,
+          std::uint64_t hash,
+          std::size_t firstChild,
+          std::size_t firstVariable,
+          double buildTime) const;
+
+      /**
+       * @brief Read the schedule from file
+       * @param fileName The file to read
+       * @param hash The expected configuration hash
+       * @param[out] buildTime The time originally taken to build the schedule
+       * @return False if the file does not exist, cannot be read or has a
+       * different hash. In this case nothing is changed.
+       */
+      bool readSchedule(
+          const std::string& fileName,
+          std::uint64_t hash,
+          double& buildTime);
+
+      /// The range of values of a column accepted by a threshold filter
+      struct ThresholdCut {
+        double lower;
+        bool lowerInclusive;
+        double upper;
+        bool upperInclusive;
+        /// Whether every value accepted by this is accepted by other
+        bool within(const ThresholdCut& other) const;
+      }; //> end struct ThresholdCut
+
+      /// A filter made up only of threshold cuts
+      struct ThresholdFilter {
+        /// The cuts on each column
+        std::map<std::string, ThresholdCut> cuts;
+        /// Whether the filter applies a weight
+        bool weighted;
+        /// Whether every entry passing this passes other
+        bool implies(const ThresholdFilter& other) const;
+      }; //> end struct ThresholdFilter
+
+      /// Hash the registered actions and their dependencies, ignoring costs
+      std::uint64_t actionsHash() const;
+
+      /**
+       * @brief Collect the filters that an action depends on, directly or
+       * through its variables
+       * @param action The action to start from
+       * @param[out] filters The names of the filters
+       * @param[out] visited The actions already followed
+       */
+      void collectFilterDependencies(
+          const Action& action,
+          std::set<std::string>& filters,
+          std::set<Action>& visited) const;
+
+      /// Convert part of the raw schedule to use action IDs
+      PendingNode internNode(ScheduleNode&& node) const;
+
+      /**
+       * @brief Add the sources to the schedule below the target
+       * @param sources The nodes still to be added
+       * @param target The node of the schedule to add them to
+       * @param preExisting The actions that already exist at this point
+       * @param state The state of the thread building this part of the
+       * schedule
+       */
       void addChildren(
-          std::vector<ScheduleNode>&& sources,
+          std::vector<PendingNode>&& sources,
           ScheduleNode* target,
-          std::set<Action> preExisting);
+          boost::dynamic_bitset<> preExisting,
+          SchedulingState& state) const;
       /// The region definitions
       std::map<std::string, RegionDef> m_regionDefs;
 
@@ -308,18 +776,62 @@ namespace RDFAnalysis {
 
       /// Keep track of actions that can be satisfied by other dependencies.
       /// This can happen when a single action defines multiple variables or
-      /// when one filter is necessarily tighter than another
+      /// when one filter is necessarily tighter than another. Only the direct
+      /// relations are stored here, the transitive closure is stored in the
+      /// satisfaction matrix.
       std::map<Action, std::set<Action>> m_satisfiedBy;
 
+      /// The interned actions, indexed by ID. These carry their costs.
+      mutable std::vector<Action> m_actionTable;
+
+      /// The ID of each interned action
+      mutable std::map<Action, ActionID_t> m_actionIDs;
+
+      /// Which of the interned actions have been defined with addAction
+      mutable boost::dynamic_bitset<> m_definedActions;
+
+      /// The position of each action in the cost ordering
+      mutable std::vector<std::size_t> m_costRanks;
+
+      /// The dependencies of action i are m_dependencyIDs[m_dependencyOffsets[i]]
+      /// to m_dependencyIDs[m_dependencyOffsets[i+1]]
+      mutable std::vector<std::size_t> m_dependencyOffsets;
+
+      /// The dependencies of all the actions, sorted by ID for each action
+      mutable std::vector<ActionID_t> m_dependencyIDs;
+
+      /// Row i holds the actions that satisfy action i. For filters this is
+      /// transitive (if A satisfies B and B satisfies C then A satisfies C).
+      /// Rows with no entries are left empty.
+      mutable std::vector<boost::dynamic_bitset<>> m_satisfactionMatrix;
+
+      /// Whether the action table reflects the registered actions
+      mutable bool m_actionTableValid{false};
+
       /// Keep the root node of the output filter schedule here
       ScheduleNode m_schedule{{FILTER, "ROOT"}};
 
       /// The variables used by this schedule
       std::vector<std::string> m_usedVars;
 
-      void expandSatisfiesRelations(
-          std::map<Action, std::set<Action>>::iterator itr,
-          std::set<Action>& processed);
+      /// The maximum number of threads used to build the schedule
+      std::size_t m_schedulingThreads{1};
+
+      /// Whether the filters in each region can be reordered
+      bool m_optimizeFilterOrder{false};
+
+      /// The expected pass fraction of each filter
+      std::map<std::string, float> m_passFractions;
+
+      /// The filters understood as threshold cuts
+      std::map<std::string, ThresholdFilter> m_thresholdFilters;
+
+      /// The file used to persist the schedule
+      std::string m_scheduleFile;
+
+      /// The regions that have been scheduled, with the filter order and the
+      /// fills that they were scheduled with
+      std::map<std::string, RegionDef> m_scheduledRegions;
   }; //> end namespace SchedulerBase
 } //> end namespace RDFAnalysis
 
@@ -0,0 +1,208 @@
+#ifndef RDFAnalysis_SysHistogram_H
+#define RDFAnalysis_SysHistogram_H
+
+// ROOT includes
+#include <TH1.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @file SysHistogram.h
+ * @brief Histogram holding many variations of the same binning.
+ */
+
+namespace RDFAnalysis {
+  /// Per-cell summaries over all the variations of a SysHistogram
+  enum class SysSummary {
+    /// The smallest content
+    Min,
+    /// The largest content
+    Max,
+    /// The sum of the contents
+    Sum,
+    /// The sum of the squared contents
+    SumSquares
+  };
+
+  /**
+   * @brief Histogram holding many variations of the same binning
+   * @tparam T The histogram type
+   *
+   * Rather than holding one T per variation, the sums of weights (and of
+   * squared weights) of all the variations are stored in a single contiguous
+   * array, indexed by bin and then by variation. Filling one entry with a
+   * weight per variation therefore touches one contiguous block of memory and
+   * the only full histogram held is the model, which is used for the binning.
+   *
+   * The per-variation histograms are only created when they are first asked
+   * for by histogram(), which is what SysResultPtr does when writing. The
+   * summaries over all variations returned by summary() are created in the
+   * same way. Histograms whose axes can extend are not supported.
+   */
+  template <typename T>
+    class SysHistogram {
+      public:
+        /**
+         * @brief Create the histogram
+         * @param model The histogram defining the binning
+         * @param nVariations The number of variations
+         */
+        SysHistogram(const T& model, std::size_t nVariations) :
+          m_model(model),
+          m_nVariations(nVariations),
+          m_nCells(m_model.GetNcells() ),
+          m_sumw(m_nCells * nVariations, 0),
+          m_sumw2(m_nCells * nVariations, 0)
+        {
+          m_model.SetDirectory(nullptr);
+          m_model.Reset();
+        }
+
+        /// The number of variations
+        std::size_t nVariations() const { return m_nVariations; }
+
+        /**
+         * @brief Fill one entry for all variations
+         * @param x The value on the x axis
+         * @param y The value on the y axis (if any)
+         * @param z The value on the z axis (if any)
+         * @param weights The weights, one per variation
+         */
+        template <typename Weights>
+          void Fill(double x, double y, double z, const Weights& weights)
+          {
+            std::size_t offset = m_model.FindBin(x, y, z) * m_nVariations;
+            double* sumw = m_sumw.data() + offset;
+            double* sumw2 = m_sumw2.data() + offset;
+            for (std::size_t idx = 0; idx < m_nVariations; ++idx) {
+              double w = weights[idx];
+              sumw[idx] += w;
+              sumw2[idx] += w*w;
+            }
+            ++m_entries;
+          }
+
+        /**
+         * @brief Add the contents of another histogram with the same binning
+         */
+        void Add(const SysHistogram& other)
+        {
+          if (other.m_sumw.size() != m_sumw.size() )
+            throw std::invalid_argument(
+                "Cannot add SysHistograms with different shapes");
+          for (std::size_t idx = 0; idx < m_sumw.size(); ++idx) {
+            m_sumw[idx] += other.m_sumw[idx];
+            m_sumw2[idx] += other.m_sumw2[idx];
+          }
+          m_entries += other.m_entries;
+        }
+
+        /**
+         * @brief Get the histogram for one variation
+         * @param variation The index of the variation
+         *
+         * The histogram is created on the first call and then kept.
+         */
+        T* histogram(std::size_t variation)
+        {
+          if (variation >= m_nVariations)
+            throw std::out_of_range(
+                "Variation " + std::to_string(variation) + " requested from a "
+                "SysHistogram with " + std::to_string(m_nVariations) );
+          std::lock_guard<std::mutex> lock(m_mutex);
+          std::unique_ptr<T>& hist = m_histograms[variation];
+          if (!hist) {
+            hist.reset(new T(m_model) );
+            hist->SetDirectory(nullptr);
+            hist->Sumw2();
+            for (std::size_t cell = 0; cell < m_nCells; ++cell) {
+              std::size_t idx = cell * m_nVariations + variation;
+              hist->SetBinContent(cell, m_sumw[idx]);
+              hist->SetBinError(cell, std::sqrt(m_sumw2[idx]) );
+            }
+            hist->SetEntries(m_entries);
+            hist->ResetStats();
+          }
+          return hist.get();
+        }
+
+        /**
+         * @brief Get a summary over all variations
+         * @param which The summary to get
+         *
+         * For the minimum and maximum each cell takes the error of the
+         * variation selected, for the sum the errors are added in quadrature
+         * and the sum of squares has no errors. The sum and sum of squares can
+         * be added between files to build the mean and RMS of the variations.
+         * The histogram is created on the first call and then kept.
+         */
+        T* summary(SysSummary which)
+        {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          std::unique_ptr<T>& hist = m_summaries[which];
+          if (!hist) {
+            hist.reset(new T(m_model) );
+            hist->SetDirectory(nullptr);
+            hist->Sumw2();
+            for (std::size_t cell = 0; cell < m_nCells; ++cell) {
+              const double* sumw = m_sumw.data() + cell * m_nVariations;
+              const double* sumw2 = m_sumw2.data() + cell * m_nVariations;
+              double content = 0;
+              double error2 = 0;
+              if (which == SysSummary::Min || which == SysSummary::Max) {
+                auto itr = which == SysSummary::Min ?
+                  std::min_element(sumw, sumw + m_nVariations) :
+                  std::max_element(sumw, sumw + m_nVariations);
+                if (itr != sumw + m_nVariations) {
+                  content = *itr;
+                  error2 = sumw2[itr - sumw];
+                }
+              }
+              else {
+                for (std::size_t idx = 0; idx < m_nVariations; ++idx) {
+                  if (which == SysSummary::Sum) {
+                    content += sumw[idx];
+                    error2 += sumw2[idx];
+                  }
+                  else
+                    content += sumw[idx] * sumw[idx];
+                }
+              }
+              hist->SetBinContent(cell, content);
+              hist->SetBinError(cell, std::sqrt(error2) );
+            }
+            hist->SetEntries(m_entries);
+            hist->ResetStats();
+          }
+          return hist.get();
+        }
+
+      private:
+        /// The model, used to find the bins
+        T m_model;
+        /// The number of variations
+        std::size_t m_nVariations;
+        /// The number of cells (including under- and overflows)
+        std::size_t m_nCells;
+        /// The sums of weights, indexed by cell and then variation
+        std::vector<double> m_sumw;
+        /// The sums of squared weights, indexed by cell and then variation
+        std::vector<double> m_sumw2;
+        /// The number of filled entries
+        double m_entries{0};
+        /// Histograms already created for each variation
+        std::map<std::size_t, std::unique_ptr<T>> m_histograms;
+        /// Summaries already created
+        std::map<SysSummary, std::unique_ptr<T>> m_summaries;
+        /// Protect the creation of the histograms
+        std::mutex m_mutex;
+    }; //> end class SysHistogram
+} //> end namespace RDFAnalysis
+#endif //> !RDFAnalysis_SysHistogram_H
@@ -3,6 +3,11 @@
 
 // Package includes
 #include "RDFAnalysis/ResultWrapper.h"
+#include "RDFAnalysis/SystematicRegistry.h"
+
+// STL includes
+#include <map>
+#include <memory>
 
 /**
  * @file SysResultPtr.h
@@ -18,30 +23,31 @@ namespace RDFAnalysis {
    * This class acts as a specialised map class holding result pointers
    * corresponding to systematic variations of the same quantity. If a
    * systematic variation is requested that does not affect this variable the
-   * nominal is returned.
+   * nominal is returned. The variations are keyed by their SysID_t, the
+   * SystematicRegistry is kept to allow converting back to names.
    */
   template <typename T>
     class SysResultPtr {
       public:
         /**
          * @brief Create the result
-         * @param nominalName The name of the nominal variation
+         * @param registry The registry used to name the systematics
          */
-        SysResultPtr(const std::string& nominalName) :
-          m_nominal(nominalName) {}
+        SysResultPtr(std::shared_ptr<const SystematicRegistry> registry) :
+          m_registry(std::move(registry) ) {}
 
         /**
          * @brief Create the result from an existing map
          * @tparam The type of the result ptr
-         * @param nominalName The name of the nominal variation
-         * @param resultMap Map of systematics to RResultPtrs
+         * @param registry The registry used to name the systematics
+         * @param resultMap Map of systematic IDs to RResultPtrs
          */
         template <typename U,
                  typename = std::enable_if_t<std::is_base_of<T, U>{} || std::is_same<T, U>{}, void>>
           SysResultPtr(
-              const std::string& nominalName,
-              const std::map<std::string, ROOT::RDF::RResultPtr<U>>& resultMap) :
-            m_nominal(nominalName)
+              std::shared_ptr<const SystematicRegistry> registry,
+              const std::map<SysID_t, ROOT::RDF::RResultPtr<U>>& resultMap) :
+            m_registry(std::move(registry) )
           {
             for (const auto& p : resultMap)
               addResult(p.first, p.second);
@@ -63,40 +69,90 @@ namespace RDFAnalysis {
         /// result)
         std::size_t size() const { return m_wrappers.size(); }
 
+        /// The registry used to name the systematics
+        const SystematicRegistry& registry() const { return *m_registry; }
+
+        /// Get the name of a systematic held here
+        const std::string& systName(SysID_t syst) const
+        { return m_registry->name(syst); }
+
+        /// The systematics held here
+        SystematicMask mask() const
+        {
+          SystematicMask result;
+          for (const auto& p : m_wrappers)
+            result.set(p.first);
+          return result;
+        }
+
         /// Set from a map
-        void setMap(const std::map<std::string, ResultWrapper<T>>& newMap) { m_wrappers = newMap; }
+        void setMap(const std::map<SysID_t, ResultWrapper<T>>& newMap) { m_wrappers = newMap; }
 
         /// Reset all results
         void reset() { m_wrappers.clear(); }
 
+        /**
+         * @brief Remove the result for a single variation
+         * @param systematic The ID of the variation to remove
+         * @return Whether there was a result to remove
+         */
+        bool removeResult(SysID_t systematic)
+        { return m_wrappers.erase(systematic) != 0; }
+
         /**
          * @brief Get the result pointed to
-         * @param syst The variation to retrieve
+         * @param syst The ID of the variation to retrieve
          * If the variation doesn't exist then return the nominal.
          */
-        T* get(const std::string& syst) 
+        T* get(SysID_t syst)
         {
           auto itr = m_wrappers.find(syst);
           return itr == m_wrappers.end()
-            ? m_wrappers.at(m_nominal).get()
+            ? m_wrappers.at(SystematicRegistry::nominalID).get()
             : itr->second.get();
         }
 
+        /**
+         * @brief Get the result pointed to
+         * @param syst The variation to retrieve
+         * If the variation doesn't exist then return the nominal.
+         */
+        T* get(const std::string& syst)
+        {
+          SysID_t id = m_registry->find(syst);
+          return get(id == SystematicRegistry::npos
+              ? SystematicRegistry::nominalID
+              : id);
+        }
+
         /**
          * @brief Add the result wrapper for a given systematic
-         * @param systematic The variation to add
+         * @param systematic The ID of the variation to add
          * @param result The result to add.
          * @return if a new result was provided
          */ 
         // TODO (maybe) - make it impossible to overwrite a result with this
         // method, or rather to make it throw an error if you try...
         bool addResult(
-            const std::string& systematic,
+            SysID_t systematic,
             const ResultWrapper<T>& result)
         {
           return m_wrappers.insert(std::make_pair(systematic, result) ).second;
         }
 
+        /**
+         * @brief Add the result wrapper for a given systematic
+         * @param systematic The variation to add
+         * @param result The result to add.
+         * @return if a new result was provided
+         */ 
+        bool addResult(
+            const std::string& systematic,
+            const ResultWrapper<T>& result)
+        {
+          return addResult(m_registry->id(systematic), result);
+        }
+
         /**
          * @brief Allow type conversions in copy construction
          * @tparam U The held type of the other object
@@ -106,7 +162,7 @@ namespace RDFAnalysis {
                   typename = std::enable_if_t<std::is_base_of<T, U>{}, void>
                  >
           SysResultPtr(const SysResultPtr<U>& other) :
-            m_nominal(other.m_nominal)
+            m_registry(other.m_registry)
           {
             for (const auto& p : other)
               m_wrappers.insert(std::make_pair(
@@ -119,8 +175,8 @@ namespace RDFAnalysis {
       private:
         template <typename U>
           friend class SysResultPtr;
-        std::string m_nominal;
-        std::map<std::string, ResultWrapper<T>> m_wrappers;
+        std::shared_ptr<const SystematicRegistry> m_registry;
+        std::map<SysID_t, ResultWrapper<T>> m_wrappers;
     };
 }
 #endif //> !RDFAnalysis_SysResultPtr_H
@@ -28,8 +28,9 @@
  * some actions it may be necessary to define additional argument classes
  * In order to do this, three things are necessary:
  *   -# A static constexpr bool member called is_rdf_sysvar which is set to true
- *   -# A translate(IBranchNamer&, const std::string&) function returning the
- *      translated argument
+ *   -# A translate(IBranchNamer&, SysID_t) function returning the translated
+ *      argument. A translate(IBranchNamer&, const std::string&) function
+ *      receiving the name of the systematic is also accepted.
  *   -# A typedef called value_type which corresponds to the return type of the
  *      translate call
  */
@@ -66,6 +67,20 @@ namespace RDFAnalysis {
       using value_type = typename std::decay_t<T>::value_type;
     };
 
+  namespace detail {
+    /// Call the translate function taking a systematic ID
+    template <typename T>
+      auto callTranslate(T&& t, IBranchNamer& namer, SysID_t syst, int)
+      -> decltype(t.translate(namer, syst) )
+      { return t.translate(namer, syst); }
+
+    /// Fall back to the translate function taking a systematic name
+    template <typename T>
+      auto callTranslate(T&& t, IBranchNamer& namer, SysID_t syst, long)
+      -> decltype(t.translate(namer, std::string{}) )
+      { return t.translate(namer, namer.registry().name(syst) ); }
+  } //> end namespace detail
+
   /**
    * @brief Translate a variable
    * @tparam T The variable to translate
@@ -75,8 +90,9 @@ namespace RDFAnalysis {
    */
   template <typename T>
   std::enable_if_t<sysvar_traits<T>::is_sysvar, typename sysvar_traits<T>::value_type> sysVarTranslate(
-      T&& t, IBranchNamer& namer, const std::string& syst) {
-    return std::forward<typename sysvar_traits<T>::value_type>(t.translate(namer, syst) );
+      T&& t, IBranchNamer& namer, SysID_t syst) {
+    return std::forward<typename sysvar_traits<T>::value_type>(
+        detail::callTranslate(t, namer, syst, 0) );
   }
 
   /**
@@ -87,7 +103,7 @@ namespace RDFAnalysis {
    */
   template <typename T>
   std::enable_if_t<!sysvar_traits<T>::is_sysvar, T> sysVarTranslate(
-      T&& t, IBranchNamer&, const std::string&) {
+      T&& t, IBranchNamer&, SysID_t) {
     return std::forward<T>(t);
   }
 
@@ -109,7 +125,7 @@ namespace RDFAnalysis {
         m_branch(branchName) {}
 
       /// Return the translated branch name
-      std::string translate(IBranchNamer& namer, const std::string& syst) {
+      std::string translate(IBranchNamer& namer, SysID_t syst) {
         return namer.nameBranch(m_branch, syst);
       }
 
@@ -136,7 +152,7 @@ namespace RDFAnalysis {
         m_branchNames(branchNames) {}
 
       /// Return the translated branch names
-      std::vector<std::string> translate(IBranchNamer& namer, const std::string& syst) {
+      std::vector<std::string> translate(IBranchNamer& namer, SysID_t syst) {
         return namer.nameBranches(m_branchNames, syst);
       }
 
@@ -163,7 +179,7 @@ namespace RDFAnalysis {
         m_branch(branchName) {}
 
       /// Return the translated branch name
-      std::string translate(IBranchNamer& namer, const std::string& syst) {
+      std::string translate(IBranchNamer& namer, SysID_t syst) {
         return namer.createBranch(m_branch, syst);
       }
 
@@ -197,7 +213,7 @@ namespace RDFAnalysis {
         m_columns(columnNames) {}
 
       /// Return the translated expression
-      std::string translate(IBranchNamer& namer, const std::string& syst) {
+      std::string translate(IBranchNamer& namer, SysID_t syst) {
         return namer.interpretExpression(m_template, m_columns, syst);
       }
 
@@ -0,0 +1,150 @@
+#ifndef RDFAnalysis_SystematicRegistry_H
+#define RDFAnalysis_SystematicRegistry_H
+
+// STL includes
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @file SystematicRegistry.h
+ * @brief Interning of systematic names into dense integer IDs.
+ */
+
+#ifndef RDFAnalysis_MAX_SYSTEMATICS
+/// The maximum number of systematics (including the nominal) that can be
+/// registered. This sets the width of the SystematicMask type.
+#define RDFAnalysis_MAX_SYSTEMATICS 1024
+#endif
+
+namespace RDFAnalysis {
+  /// The integer ID of a systematic variation
+  using SysID_t = std::size_t;
+
+  /// Fixed-width set of systematic variations, indexed by SysID_t
+  using SystematicMask = std::bitset<RDFAnalysis_MAX_SYSTEMATICS>;
+
+  /**
+   * @brief A group of systematics that is only consumed through per-bin
+   * summaries, for instance a set of PDF replicas.
+   *
+   * Each summary is stored under its own ID, named after the group with the
+   * suffix "__min", "__max", "__sum" or "__sumsq".
+   */
+  struct SystematicGroup {
+    /// The name of the group
+    std::string name;
+    /// The members of the group
+    SystematicMask members;
+    /// The IDs of the minimum, maximum, sum and sum of squares, in that order
+    std::array<SysID_t, 4> summaries;
+  }; //> end struct SystematicGroup
+
+  /**
+   * @brief Map between systematic names and dense integer IDs.
+   *
+   * Every systematic known to an IBranchNamer is assigned an ID when it is
+   * registered. IDs are assigned in order of registration, starting from 0,
+   * which always refers to the nominal variation. Internally the Node classes
+   * only deal in these IDs (or in SystematicMasks built from them), the names
+   * are only needed when talking to the underlying ROOT::RNode objects or when
+   * writing outputs.
+   *
+   * A single registry is shared between a namer and all of its copies so the
+   * IDs are consistent throughout the whole tree of nodes.
+   */
+  class SystematicRegistry {
+    public:
+      /// The ID of the nominal variation
+      static constexpr SysID_t nominalID = 0;
+
+      /// Returned by find if a name is not registered
+      static constexpr SysID_t npos = static_cast<SysID_t>(-1);
+
+      /**
+       * @brief Create the registry
+       * @param nominalName The name of the nominal variation
+       */
+      SystematicRegistry(const std::string& nominalName = "");
+
+      /**
+       * @brief Register a systematic
+       * @param name The name of the systematic to add
+       * @return The ID of the systematic
+       * @exception std::length_error If RDFAnalysis_MAX_SYSTEMATICS would be
+       * exceeded
+       *
+       * If the name is already registered its existing ID is returned.
+       */
+      SysID_t intern(const std::string& name);
+
+      /**
+       * @brief Get the ID of a systematic
+       * @param name The name of the systematic. The empty string refers to the
+       * nominal.
+       * @exception std::out_of_range If the systematic is not registered
+       */
+      SysID_t id(const std::string& name) const;
+
+      /**
+       * @brief Find the ID of a systematic
+       * @param name The name of the systematic. The empty string refers to the
+       * nominal.
+       * @return The ID or npos if the systematic is not registered
+       */
+      SysID_t find(const std::string& name) const;
+
+      /**
+       * @brief Get the name of a systematic
+       * @exception std::out_of_range If the ID is not registered
+       */
+      const std::string& name(SysID_t id) const { return m_names.at(id); }
+
+      /// The name of the nominal variation
+      const std::string& nominalName() const { return m_names.front(); }
+
+      /// The number of registered systematics (including the nominal)
+      std::size_t size() const { return m_names.size(); }
+
+      /// All registered names, ordered by ID
+      const std::vector<std::string>& names() const { return m_names; }
+
+      /// Build a mask from a set of names
+      SystematicMask mask(const std::set<std::string>& names) const;
+
+      /// Convert a mask back into a set of names
+      std::set<std::string> names(const SystematicMask& mask) const;
+
+      /**
+       * @brief Declare a group of systematics only consumed through summaries
+       * @param name The name of the group
+       * @param members The systematics in the group
+       * @return The group
+       * @exception std::invalid_argument If the group or one of its members
+       * is already declared, or a member is the nominal
+       * @exception std::out_of_range If a member is not registered
+       *
+       * The IDs of the summaries are registered here.
+       */
+      const SystematicGroup& declareGroup(
+          const std::string& name,
+          const std::set<std::string>& members);
+
+      /// All declared groups
+      const std::vector<SystematicGroup>& groups() const { return m_groups; }
+
+    private:
+      /// The names, indexed by ID
+      std::vector<std::string> m_names;
+      /// The IDs, indexed by name
+      std::unordered_map<std::string, SysID_t> m_ids;
+      /// The declared groups
+      std::vector<SystematicGroup> m_groups;
+  }; //> end class SystematicRegistry
+} //> end namespace RDFAnalysis
+
+#endif //> !RDFAnalysis_SystematicRegistry_H
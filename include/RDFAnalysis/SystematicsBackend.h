@@ -0,0 +1,40 @@
+#ifndef RDFAnalysis_SystematicsBackend_H
+#define RDFAnalysis_SystematicsBackend_H
+
+// ROOT includes
+#include <RVersion.h>
+
+/**
+ * @file SystematicsBackend.h
+ * @brief Choice of how a tree propagates its systematic variations.
+ */
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,26,0)
+/// Defined if RDataFrame provides Vary and VariationsFor
+#define RDFAnalysis_HAS_VARY
+#endif
+
+namespace RDFAnalysis {
+  /**
+   * @brief How a tree of nodes evaluates its systematic variations
+   *
+   * With the Clone backend every action affected by a systematic is booked
+   * again on the nominal RNode with its inputs translated by the branch namer,
+   * and filters affected by a systematic split the tree into one RNode per
+   * variation. This works with any ROOT version but the number of booked
+   * actions and filters grows with the number of systematics.
+   *
+   * With the Vary backend the varied input branches are declared once on the
+   * root RNode with RNode::Vary and every action is booked only on the nominal
+   * RNode. RDataFrame then propagates the variations through the graph itself
+   * and the varied results are retrieved with VariationsFor. This requires
+   * ROOT 6.26 or newer and every booked result must support variations.
+   */
+  enum class SystematicsBackend {
+    /// Clone actions onto one RNode per variation
+    Clone,
+    /// Use RDataFrame's native Vary and VariationsFor
+    Vary
+  };
+} //> end namespace RDFAnalysis
+#endif //> !RDFAnalysis_SystematicsBackend_H
@@ -0,0 +1,86 @@
+#ifndef RDFAnalysis_TimedCallable_H
+#define RDFAnalysis_TimedCallable_H
+
+#include <ROOT/RDataFrame.hxx>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @file TimedCallable.h
+ * @brief Helpers to measure the time spent in user functors.
+ */
+
+namespace RDFAnalysis {
+  /**
+   * @brief Record of the time spent in a single action
+   *
+   * The counters are atomic so one profile can be shared between all of the
+   * threads of an event loop.
+   */
+  struct ActionProfile {
+    /// The number of times the action was called
+    std::atomic<std::uint64_t> nCalls{0};
+    /// The total time spent in the action
+    std::atomic<std::uint64_t> nanoseconds{0};
+
+    /// Record a single call
+    void record(std::chrono::steady_clock::duration elapsed)
+    {
+      nCalls.fetch_add(1, std::memory_order_relaxed);
+      nanoseconds.fetch_add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+          std::memory_order_relaxed);
+    }
+
+    /// Reset the counters
+    void reset()
+    {
+      nCalls = 0;
+      nanoseconds = 0;
+    }
+  }; //> end struct ActionProfile
+
+  namespace detail {
+    /**
+     * @brief Wrap a functor so that each call is timed
+     * @tparam F The wrapped functor type
+     *
+     * The call operator has the same argument and return types as the wrapped
+     * functor so RDataFrame deduces the same column types for both.
+     */
+    template <typename F,
+              typename Args = typename ROOT::TTraits::CallableTraits<F>::arg_types>
+      class TimedCallable;
+
+    template <typename F, typename... Args>
+      class TimedCallable<F, ROOT::TTraits::TypeList<Args...>> {
+        public:
+          /// The return type of the wrapped functor
+          using ret_type = typename ROOT::TTraits::CallableTraits<F>::ret_type;
+
+          /**
+           * @brief Create the wrapper
+           * @param f The functor to wrap
+           * @param profile The profile to record the calls in
+           */
+          TimedCallable(F f, std::shared_ptr<ActionProfile> profile) :
+            m_f(f), m_profile(std::move(profile) ) {}
+
+          /// Call the wrapped functor
+          ret_type operator()(Args&... args) const
+          {
+            auto start = std::chrono::steady_clock::now();
+            ret_type result = m_f(args...);
+            m_profile->record(std::chrono::steady_clock::now() - start);
+            return result;
+          }
+        private:
+          mutable F m_f;
+          std::shared_ptr<ActionProfile> m_profile;
+      }; //> end class TimedCallable
+  } //> end namespace detail
+} //> end namespace RDFAnalysis
+
+#endif //> !RDFAnalysis_TimedCallable_H
@@ -0,0 +1,49 @@
+#ifndef RDFAnalysis_TypedFill_H
+#define RDFAnalysis_TypedFill_H
+
+// ROOT includes
+#include <ROOT/RDataFrame.hxx>
+
+// STL includes
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file TypedFill.h
+ * @brief Fill actions whose column types are known at compile time.
+ */
+
+namespace RDFAnalysis { namespace detail {
+  /**
+   * @brief Book RNode::Fill with the types of its columns
+   * @tparam ColTypes The types of the filled columns
+   *
+   * If the column list has one more column than there are types, that column
+   * is the weight. Its type is read from the RNode, and the fill is fully
+   * typed if it is a double or a float. For any other weight type (and if
+   * the number of columns does not match the types at all) RNode::Fill has
+   * to work out the column types itself, which needs the interpreter.
+   */
+  template <typename... ColTypes>
+    struct TypedFill {
+      template <typename T>
+        ROOT::RDF::RResultPtr<T> operator()(
+            ROOT::RDF::RNode& rnode,
+            T&& model,
+            const std::vector<std::string>& columns) const
+        {
+          if (columns.size() == sizeof...(ColTypes) )
+            return rnode.Fill<ColTypes...>(std::move(model), columns);
+          if (columns.size() == sizeof...(ColTypes) + 1) {
+            std::string weightType = rnode.GetColumnType(columns.back() );
+            if (weightType == "double" || weightType == "Double_t")
+              return rnode.Fill<ColTypes..., double>(std::move(model), columns);
+            if (weightType == "float" || weightType == "Float_t")
+              return rnode.Fill<ColTypes..., float>(std::move(model), columns);
+          }
+          return rnode.Fill(std::move(model), columns);
+        }
+    }; //> end struct TypedFill
+} } //> end namespace RDFAnalysis::detail
+#endif //> !RDFAnalysis_TypedFill_H
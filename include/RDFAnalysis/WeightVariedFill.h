@@ -0,0 +1,353 @@
+#ifndef RDFAnalysis_WeightVariedFill_H
+#define RDFAnalysis_WeightVariedFill_H
+
+// Package includes
+#include "RDFAnalysis/Helpers.h"
+#include "RDFAnalysis/SysHistogram.h"
+#include "RDFAnalysis/DeltaHistogram.h"
+
+// ROOT includes
+#include <ROOT/RDataFrame.hxx>
+#include <ROOT/RDF/RActionImpl.hxx>
+#include <TH1.h>
+
+// STL includes
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class TTreeReader;
+
+/**
+ * @file WeightVariedFill.h
+ * @brief RDataFrame actions filling several variations of a histogram at once.
+ */
+
+namespace RDFAnalysis {
+  namespace detail {
+    /// Test whether T has a Fill method taking N values and a weight
+    template <typename T, typename Seq, typename = void>
+      struct HasWeightedFillImpl : std::false_type {};
+
+    template <typename T, std::size_t... Is>
+      struct HasWeightedFillImpl<T, std::index_sequence<Is...>, decltype(
+          std::declval<T&>().Fill( ( (void)Is, 0.)...), void() )>
+      : std::true_type {};
+
+    /// Test whether T has a Fill method taking N values and a weight
+    template <typename T, std::size_t N>
+      using HasWeightedFill = HasWeightedFillImpl<T, std::make_index_sequence<N+1>>;
+
+    /**
+     * @brief The number of values taken by the weighted Fill of a histogram
+     *
+     * This is 0 for types that are not histograms. The higher dimensions are
+     * tested first as, e.g., TH3 also has a Fill taking three values.
+     */
+    template <typename T>
+      struct FillDimension : std::integral_constant<std::size_t,
+        !std::is_base_of<TH1, T>::value ? 0 :
+        HasWeightedFill<T, 3>::value ? 3 :
+        HasWeightedFill<T, 2>::value ? 2 :
+        HasWeightedFill<T, 1>::value ? 1 : 0> {};
+
+    /**
+     * @brief Action filling a histogram for each of several weights
+     * @tparam T The histogram type
+     *
+     * The action takes FillDimension<T> columns of values and then a column of
+     * weights, all as ROOT::RVec<double>. Value vectors of size 1 are
+     * broadcast against the others, so scalar and container columns can be
+     * mixed in the same way as for RNode::Fill. Each value is then filled
+     * into variation i with weight i of a SysHistogram.
+     */
+    template <typename T>
+      class WeightVariedFillHelper
+      : public ROOT::Detail::RDF::RActionImpl<WeightVariedFillHelper<T>> {
+        public:
+          /// The number of value columns
+          static constexpr std::size_t dimension = FillDimension<T>::value;
+          /// The result, holding one variation per weight
+          using Result_t = SysHistogram<T>;
+
+          /**
+           * @brief Create the helper
+           * @param model The histogram to copy
+           * @param nWeights The number of weights
+           */
+          WeightVariedFillHelper(const T& model, std::size_t nWeights)
+          {
+            unsigned int nSlots = getNSlots();
+            m_slots.reserve(nSlots);
+            for (unsigned int slot = 0; slot < nSlots; ++slot) {
+              m_slots.push_back(std::make_shared<Result_t>(model, nWeights) );
+            }
+          }
+
+          /// Move constructor
+          WeightVariedFillHelper(WeightVariedFillHelper&&) = default;
+
+          /// Called before the event loop
+          void Initialize() {}
+
+          /// Called at the start of each task
+          void InitTask(TTreeReader*, unsigned int) {}
+
+          /// Fill all of the histograms for this slot
+          template <typename... Columns>
+            void Exec(unsigned int slot, const Columns&... columns)
+            {
+              static_assert(sizeof...(Columns) == dimension + 1,
+                  "Expected one column per dimension and a weight column");
+              std::array<const ROOT::VecOps::RVec<double>*, dimension+1> inputs{{&columns...}};
+              const ROOT::VecOps::RVec<double>& weights = *inputs.back();
+              Result_t& object = *m_slots.at(slot);
+              if (weights.size() != object.nVariations() )
+                throw std::runtime_error(
+                    "Received " + std::to_string(weights.size() ) + " weights "
+                    "for " + std::to_string(object.nVariations() ) + " variations");
+              // Work out how many values there are
+              std::size_t nValues = 1;
+              for (std::size_t dim = 0; dim < dimension; ++dim) {
+                std::size_t size = inputs[dim]->size();
+                if (size == 0)
+                  return;
+                if (size == 1)
+                  continue;
+                if (nValues != 1 && size != nValues)
+                  throw std::runtime_error(
+                      "Cannot fill from containers of different sizes");
+                nValues = size;
+              }
+              // Unused axes are left at 0
+              std::array<double, 3> values{{0, 0, 0}};
+              for (std::size_t idx = 0; idx < nValues; ++idx) {
+                for (std::size_t dim = 0; dim < dimension; ++dim)
+                  values[dim] = (*inputs[dim])[inputs[dim]->size() == 1 ? 0 : idx];
+                object.Fill(values[0], values[1], values[2], weights);
+              }
+            }
+
+          /// Merge the slots into the first one
+          void Finalize()
+          {
+            for (std::size_t slot = 1; slot < m_slots.size(); ++slot)
+              m_slots.front()->Add(*m_slots[slot]);
+          }
+
+          /// The merged result
+          std::shared_ptr<Result_t> GetResultPtr() const { return m_slots.front(); }
+
+          /// The name of this action
+          std::string GetActionName() { return "WeightVariedFill"; }
+
+        private:
+          /// The histograms for each slot
+          std::vector<std::shared_ptr<Result_t>> m_slots;
+      }; //> end class WeightVariedFillHelper
+
+    /**
+     * @brief Book a WeightVariedFillHelper
+     * @param rnode The RNode to book the action on
+     * @param helper The helper
+     * @param columns The value columns followed by the weight column
+     */
+    template <typename T, std::size_t... Is>
+      ROOT::RDF::RResultPtr<SysHistogram<T>> bookWeightVariedFill(
+          ROOT::RDF::RNode& rnode,
+          WeightVariedFillHelper<T>&& helper,
+          const ROOT::RDF::ColumnNames_t& columns,
+          std::index_sequence<Is...>)
+      {
+        return rnode.Book<std::conditional_t<true,
+               ROOT::VecOps::RVec<double>,
+               std::integral_constant<std::size_t, Is>>...>(
+                   std::move(helper), columns);
+      }
+
+    /**
+     * @brief Action filling the differences of variations from the nominal
+     * @tparam T The histogram type
+     *
+     * The action takes FillDimension<T> columns, each holding the values of
+     * every variation as a ROOT::RVec<ROOT::RVec<double>>, and then a column
+     * holding the weight of every variation. The first variation is the
+     * nominal. On each event the bins that each variation would fill are
+     * compared to the nominal ones and only those entries whose bin or weight
+     * differ are recorded, in a DeltaHistogram. The values of each variation
+     * are broadcast in the same way as for WeightVariedFillHelper.
+     */
+    template <typename T>
+      class DeltaFillHelper
+      : public ROOT::Detail::RDF::RActionImpl<DeltaFillHelper<T>> {
+        public:
+          /// The number of value columns
+          static constexpr std::size_t dimension = FillDimension<T>::value;
+          /// The result, holding the differences from the nominal
+          using Result_t = DeltaHistogram<T>;
+
+          /**
+           * @brief Create the helper
+           * @param model The histogram defining the binning
+           * @param nVariations The number of variations, including the nominal
+           */
+          DeltaFillHelper(const T& model, std::size_t nVariations) :
+            m_nominalCells(getNSlots() ),
+            m_cells(getNSlots() )
+          {
+            unsigned int nSlots = getNSlots();
+            m_slots.reserve(nSlots);
+            for (unsigned int slot = 0; slot < nSlots; ++slot) {
+              m_slots.push_back(std::make_shared<Result_t>(model, nVariations) );
+            }
+          }
+
+          /// Move constructor
+          DeltaFillHelper(DeltaFillHelper&&) = default;
+
+          /// Called before the event loop
+          void Initialize() {}
+
+          /// Called at the start of each task
+          void InitTask(TTreeReader*, unsigned int) {}
+
+          /// Record the differences for this slot
+          template <typename... Columns>
+            void Exec(unsigned int slot, const Columns&... columns)
+            {
+              static_assert(sizeof...(Columns) == dimension + 1,
+                  "Expected one column per dimension and a weight column");
+              exec(slot,
+                  std::forward_as_tuple(columns...),
+                  std::make_index_sequence<dimension>() );
+            }
+
+          /// Merge the slots into the first one
+          void Finalize()
+          {
+            for (std::size_t slot = 1; slot < m_slots.size(); ++slot)
+              m_slots.front()->Add(*m_slots[slot]);
+          }
+
+          /// The merged result
+          std::shared_ptr<Result_t> GetResultPtr() const { return m_slots.front(); }
+
+          /// The name of this action
+          std::string GetActionName() { return "DeltaFill"; }
+
+        private:
+          /// The values of every variation in each dimension
+          using Inputs_t = std::array<
+            const ROOT::VecOps::RVec<ROOT::VecOps::RVec<double>>*, dimension>;
+
+          /// Unpack the columns
+          template <typename Tuple, std::size_t... Is>
+            void exec(unsigned int slot, const Tuple& columns, std::index_sequence<Is...>)
+            {
+              Inputs_t inputs{{&std::get<Is>(columns)...}};
+              const ROOT::VecOps::RVec<double>& weights = std::get<dimension>(columns);
+              Result_t& object = *m_slots.at(slot);
+              std::size_t nVariations = object.nVariations();
+              if (weights.size() != nVariations)
+                throw std::runtime_error(
+                    "Received " + std::to_string(weights.size() ) + " weights "
+                    "for " + std::to_string(nVariations) + " variations");
+              for (const auto* input : inputs)
+                if (input->size() != nVariations)
+                  throw std::runtime_error(
+                      "Received " + std::to_string(input->size() ) + " values "
+                      "for " + std::to_string(nVariations) + " variations");
+              std::vector<int>& nominalCells = m_nominalCells.at(slot);
+              std::vector<int>& cells = m_cells.at(slot);
+              findCells(object, inputs, 0, nominalCells);
+              double nominalWeight = weights[0];
+              for (std::size_t var = 1; var < nVariations; ++var) {
+                findCells(object, inputs, var, cells);
+                double weight = weights[var];
+                if (cells.size() == nominalCells.size() ) {
+                  // Only touch the entries that actually changed
+                  for (std::size_t idx = 0; idx < cells.size(); ++idx) {
+                    if (cells[idx] == nominalCells[idx] && weight == nominalWeight)
+                      continue;
+                    object.remove(var, nominalCells[idx], nominalWeight);
+                    object.add(var, cells[idx], weight);
+                  }
+                }
+                else {
+                  for (int cell : nominalCells)
+                    object.remove(var, cell, nominalWeight);
+                  for (int cell : cells)
+                    object.add(var, cell, weight);
+                  object.addEntries(var,
+                      static_cast<double>(cells.size() ) - nominalCells.size() );
+                }
+              }
+            }
+
+          /// Find the cells filled by one variation
+          void findCells(
+              Result_t& object,
+              const Inputs_t& inputs,
+              std::size_t variation,
+              std::vector<int>& cells)
+          {
+            cells.clear();
+            // Work out how many values there are
+            std::size_t nValues = 1;
+            for (std::size_t dim = 0; dim < dimension; ++dim) {
+              std::size_t size = (*inputs[dim])[variation].size();
+              if (size == 0)
+                return;
+              if (size == 1)
+                continue;
+              if (nValues != 1 && size != nValues)
+                throw std::runtime_error(
+                    "Cannot fill from containers of different sizes");
+              nValues = size;
+            }
+            // Unused axes are left at 0
+            std::array<double, 3> values{{0, 0, 0}};
+            for (std::size_t idx = 0; idx < nValues; ++idx) {
+              for (std::size_t dim = 0; dim < dimension; ++dim) {
+                const ROOT::VecOps::RVec<double>& input = (*inputs[dim])[variation];
+                values[dim] = input[input.size() == 1 ? 0 : idx];
+              }
+              cells.push_back(object.FindBin(values[0], values[1], values[2]) );
+            }
+          }
+
+          /// The differences for each slot
+          std::vector<std::shared_ptr<Result_t>> m_slots;
+          /// Scratch space for the nominal cells of each slot
+          std::vector<std::vector<int>> m_nominalCells;
+          /// Scratch space for the varied cells of each slot
+          std::vector<std::vector<int>> m_cells;
+      }; //> end class DeltaFillHelper
+
+    /**
+     * @brief Book a DeltaFillHelper
+     * @param rnode The RNode to book the action on
+     * @param helper The helper
+     * @param columns The value columns followed by the weight column
+     */
+    template <typename T, std::size_t... Is>
+      ROOT::RDF::RResultPtr<DeltaHistogram<T>> bookDeltaFill(
+          ROOT::RDF::RNode& rnode,
+          DeltaFillHelper<T>&& helper,
+          const ROOT::RDF::ColumnNames_t& columns,
+          std::index_sequence<Is...>)
+      {
+        return rnode.Book<std::conditional_t<true,
+               ROOT::VecOps::RVec<ROOT::VecOps::RVec<double>>,
+               std::integral_constant<std::size_t, Is>>...,
+               ROOT::VecOps::RVec<double>>(
+                   std::move(helper), columns);
+      }
+  } //> end namespace detail
+} //> end namespace RDFAnalysis
+#endif //> !RDFAnalysis_WeightVariedFill_H
@@ -0,0 +1,421 @@
+#include "RDFAnalysis/CompiledExpression.h"
+#include "RDFAnalysis/ExpressionEvaluator.h"
+#include "RDFAnalysis/Helpers.h"
+#include <TInterpreter.h>
+#include <TSystem.h>
+#include <boost/algorithm/string/join.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+  using RNode = ROOT::RDF::RNode;
+  using ColumnNames_t = std::vector<std::string>;
+
+  /// The compiled function, booking the action on the first RNode and
+  /// writing the result into the second
+  using Booker_t = void (*)(RNode*, RNode*, const std::string*, const ColumnNames_t*);
+
+  /// The kinds of action that can be compiled
+  enum class Kind { Define, Filter };
+
+  /// An expression template compiled for one set of column types
+  struct Compiled {
+    /// The compiled function
+    Booker_t booker;
+    /// Columns used by the template that were not among its inputs
+    ColumnNames_t extraColumns;
+    /// The name of the function
+    std::string function;
+    /// The definition of the function
+    std::string code;
+  };
+
+  /// An expression template that is ready to be compiled
+  struct Prepared {
+    /// The key of the template in the cache
+    std::string key;
+    /// The name of the function
+    std::string function;
+    /// The definition of the function
+    std::string code;
+    /// Columns used by the template that were not among its inputs
+    ColumnNames_t extraColumns;
+  };
+
+  /// 64 bit FNV-1a hash, which is the same for every build
+  std::uint64_t stableHash(const std::string& value)
+  {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (char c : value) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  /// Write a hash as hex
+  std::string toHex(std::uint64_t value)
+  {
+    std::ostringstream os;
+    os << std::hex << std::setw(16) << std::setfill('0') << value;
+    return os.str();
+  }
+
+  /// Protects the cache and the interpreter
+  std::mutex& cacheMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  /// Everything compiled so far, keyed by template and column types
+  std::map<std::string, Compiled>& cache()
+  {
+    static std::map<std::string, Compiled> theCache;
+    return theCache;
+  }
+
+  /// The number of batches compiled or loaded from the cache directory
+  std::size_t& batchCount()
+  {
+    static std::size_t count = 0;
+    return count;
+  }
+
+  /// The directory for the compiled libraries
+  std::string& cacheDirectory()
+  {
+    static std::string directory;
+    return directory;
+  }
+
+  /// The key of a template in the cache
+  std::string cacheKey(
+      RNode& rnode,
+      Kind kind,
+      const std::string& expression,
+      const ColumnNames_t& columns,
+      std::vector<std::string>& types)
+  {
+    types.clear();
+    types.reserve(columns.size() );
+    for (const std::string& column : columns)
+      types.push_back(rnode.GetColumnType(column) );
+    return (kind == Kind::Define ? "Define:" : "Filter:") +
+      expression + ":" + boost::algorithm::join(types, ",");
+  }
+
+  /**
+   * @brief Generate the function for an expression template
+   * @param rnode The RNode the template will be used on
+   * @param kind The kind of action to book
+   * @param expression The expression template
+   * @param columns The columns to substitute into the template
+   * @param key The key of the template in the cache
+   * @param types The types of the columns
+   */
+  Prepared prepare(
+      RNode& rnode,
+      Kind kind,
+      const std::string& expression,
+      const ColumnNames_t& columns,
+      const std::string& key,
+      std::vector<std::string> types)
+  {
+    // Replace the placeholders by the arguments of the function
+    static const std::regex placeholder("\\{(\\d+)\\}");
+    std::string body = std::regex_replace(expression, placeholder, "_rdfa_$1");
+    // Any other identifier that is a column of the RNode also becomes an
+    // argument, as it would in a string passed to RNode::Define. Skip
+    // anything that is accessed as a member.
+    ColumnNames_t knownColumns = rnode.GetColumnNames();
+    std::set<std::string> known(knownColumns.begin(), knownColumns.end() );
+    known.insert("rdfentry_");
+    known.insert("rdfslot_");
+    ColumnNames_t extra;
+    static const std::regex identifier("(\\.|::|->)?\\s*\\b([A-Za-z_]\\w*)");
+    std::string replaced;
+    std::size_t last = 0;
+    for (auto match = std::sregex_iterator(body.begin(), body.end(), identifier);
+        match != std::sregex_iterator(); ++match) {
+      if ( (*match)[1].matched || !known.count( (*match)[2].str() ) )
+        continue;
+      std::string column = (*match)[2].str();
+      auto extraItr = std::find(extra.begin(), extra.end(), column);
+      std::size_t idx = columns.size() + (extraItr - extra.begin() );
+      if (extraItr == extra.end() ) {
+        extra.push_back(column);
+        types.push_back(rnode.GetColumnType(column) );
+      }
+      replaced += body.substr(last, match->position(2) - last) +
+        "_rdfa_" + std::to_string(idx);
+      last = match->position(2) + match->length(2);
+    }
+    body = replaced + body.substr(last);
+
+    // Build the function. It is named after its key, so the same template
+    // always gives the same code. Different templates can give the same
+    // body (e.g. '{0} > 30' on pt and 'pt > 30' on no columns) and naming
+    // the function after its content would define it twice.
+    std::vector<std::string> arguments;
+    arguments.reserve(types.size() );
+    for (std::size_t idx = 0; idx < types.size(); ++idx)
+      arguments.push_back("const " + types.at(idx) + "& _rdfa_" + std::to_string(idx) );
+    std::string lambda = "[] (" + boost::algorithm::join(arguments, ", ") + ") " +
+      (kind == Kind::Define ? "" : "-> bool ") + "{ return (" + body + "); }";
+    std::string call = kind == Kind::Define ?
+      "input->Define(*name, " + lambda + ", *columns)" :
+      "input->Filter(" + lambda + ", *columns, *name)";
+    std::string function = "expression_" + toHex(stableHash(key) );
+    std::string code =
+      "  void " + function + "(ROOT::RDF::RNode* input, ROOT::RDF::RNode* output, "
+      "const std::string* name, const std::vector<std::string>* columns) {\n"
+      "    *output = " + call + ";\n"
+      "  }\n";
+    return Prepared{key, function, code, std::move(extra)};
+  }
+
+  /**
+   * @brief Compile a batch of prepared templates and add them to the cache
+   * @param batch The templates, which must not be in the cache already
+   * @return Whether the compilation succeeded
+   *
+   * The whole batch is compiled as one translation unit. If a cache
+   * directory is set this is compiled into a library in that directory,
+   * unless a library for the same code is already there. Otherwise, or if
+   * that fails, it is declared to the interpreter.
+   */
+  bool compileBatch(const std::vector<Prepared>& batch)
+  {
+    if (batch.empty() )
+      return true;
+    std::string functions;
+    std::string table;
+    for (std::size_t idx = 0; idx < batch.size(); ++idx) {
+      functions += batch.at(idx).code;
+      table += "  functions[" + std::to_string(idx) + "] = "
+        "reinterpret_cast<void*>(&RDFAnalysis_Compiled::" + batch.at(idx).function + ");\n";
+    }
+    std::string body =
+      "#include <ROOT/RDataFrame.hxx>\n"
+      "namespace RDFAnalysis_Compiled {\n" + functions + "}\n";
+    std::string entry = "RDFAnalysis_Compiled_" + toHex(stableHash(body + table) );
+    std::string code = body +
+      "extern \"C\" void " + entry + "(void** functions) {\n" + table + "}\n";
+
+    using Entry_t = void (*)(void**);
+    Entry_t entryPoint = nullptr;
+    const std::string& directory = cacheDirectory();
+    if (!directory.empty() ) {
+      std::string fileName = directory + "/" + entry + ".C";
+      // Keep an existing file so that its library is not rebuilt. Another job
+      // may be writing the same file, so it is only ever moved into place
+      // complete.
+      if (!std::ifstream(fileName) )
+        RDFAnalysis::writeFileAtomically(
+            fileName, [&code] (std::ostream& os) { os << code; });
+      if (gSystem->CompileMacro(fileName.c_str(), "kO") )
+        entryPoint = reinterpret_cast<Entry_t>(
+            gSystem->DynFindSymbol("*", entry.c_str() ) );
+      // ACLiC only sees the RDataFrame header, so column types from other
+      // headers or from user dictionaries can stop it. The interpreter knows
+      // about those types, so try again there.
+      if (!entryPoint)
+        std::cout << "Failed to build " << fileName
+          << ", compiling it with the interpreter instead" << std::endl;
+    }
+    if (!entryPoint) {
+      if (!gInterpreter->Declare(code.c_str() ) )
+        return false;
+      entryPoint = reinterpret_cast<Entry_t>(gInterpreter->Calc(
+            ("(long)&" + entry).c_str() ) );
+    }
+    if (!entryPoint)
+      return false;
+    ++batchCount();
+    std::vector<void*> pointers(batch.size(), nullptr);
+    entryPoint(pointers.data() );
+    for (std::size_t idx = 0; idx < batch.size(); ++idx)
+      cache().emplace(
+          batch.at(idx).key,
+          Compiled{
+            reinterpret_cast<Booker_t>(pointers.at(idx) ),
+            batch.at(idx).extraColumns,
+            batch.at(idx).function,
+            batch.at(idx).code});
+    return true;
+  }
+
+  /// Write a string as a C++ raw string literal
+  std::string rawLiteral(const std::string& value)
+  {
+    std::string delimiter = "RDFA";
+    while (value.find(")" + delimiter + "\"") != std::string::npos)
+      delimiter += "_";
+    return "R\"" + delimiter + "(" + value + ")" + delimiter + "\"";
+  }
+
+  /**
+   * @brief Get the compiled version of a template, compiling it if necessary
+   * @param rnode The RNode the template will be used on
+   * @param kind The kind of action to book
+   * @param expression The expression template
+   * @param columns The columns to substitute into the template
+   */
+  const Compiled& compile(
+      RNode& rnode,
+      Kind kind,
+      const std::string& expression,
+      const ColumnNames_t& columns)
+  {
+    std::vector<std::string> types;
+    std::string key = cacheKey(rnode, kind, expression, columns, types);
+    std::lock_guard<std::mutex> lock(cacheMutex() );
+    auto itr = cache().find(key);
+    if (itr != cache().end() )
+      return itr->second;
+    if (!compileBatch({prepare(rnode, kind, expression, columns, key, types)}) )
+      throw std::runtime_error("Failed to compile expression '" + expression + "'");
+    return cache().at(key);
+  }
+
+  /// Book a compiled template on an RNode
+  RNode book(
+      RNode& rnode,
+      Kind kind,
+      const std::string& name,
+      const std::string& expression,
+      const ColumnNames_t& columns)
+  {
+    // Simple expressions do not need the interpreter at all
+    RNode output = rnode;
+    if (kind == Kind::Define ?
+        RDFAnalysis::detail::defineEvaluated(rnode, output, name, expression, columns) :
+        RDFAnalysis::detail::filterEvaluated(rnode, output, expression, columns, name) )
+      return output;
+    const Compiled& compiled = compile(rnode, kind, expression, columns);
+    ColumnNames_t allColumns = columns;
+    allColumns.insert(
+        allColumns.end(),
+        compiled.extraColumns.begin(),
+        compiled.extraColumns.end() );
+    compiled.booker(&rnode, &output, &name, &allColumns);
+    return output;
+  }
+} //> end anonymous namespace
+
+namespace RDFAnalysis { namespace detail {
+  ROOT::RDF::RNode defineCompiled(
+      ROOT::RDF::RNode& rnode,
+      const std::string& name,
+      const std::string& expression,
+      const std::vector<std::string>& columns)
+  {
+    return book(rnode, Kind::Define, name, expression, columns);
+  }
+
+  ROOT::RDF::RNode filterCompiled(
+      ROOT::RDF::RNode& rnode,
+      const std::string& expression,
+      const std::vector<std::string>& columns,
+      const std::string& filterName)
+  {
+    return book(rnode, Kind::Filter, filterName, expression, columns);
+  }
+
+  bool compileExpressions(
+      ROOT::RDF::RNode& rnode,
+      const std::vector<ExpressionRequest>& requests)
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex() );
+    std::vector<Prepared> batch;
+    std::set<std::string> keys;
+    std::vector<std::string> types;
+    for (const ExpressionRequest& request : requests) {
+      if (canEvaluate(rnode, request.expression, request.columns, request.filter) )
+        continue;
+      Kind kind = request.filter ? Kind::Filter : Kind::Define;
+      std::string key = cacheKey(rnode, kind, request.expression, request.columns, types);
+      if (cache().count(key) || !keys.insert(key).second)
+        continue;
+      batch.push_back(prepare(rnode, kind, request.expression, request.columns, key, types) );
+    }
+    return compileBatch(batch);
+  }
+
+  void registerCompiledExpression(
+      const std::string& key,
+      void (*booker)(
+        ROOT::RDF::RNode*,
+        ROOT::RDF::RNode*,
+        const std::string*,
+        const std::vector<std::string>*),
+      const std::vector<std::string>& extraColumns,
+      const std::string& function,
+      const std::string& code)
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex() );
+    cache().emplace(key, Compiled{booker, extraColumns, function, code});
+  }
+
+  std::size_t compiledBatchCount()
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex() );
+    return batchCount();
+  }
+} } //> end namespace RDFAnalysis::detail
+
+namespace RDFAnalysis {
+  void setCompiledExpressionDirectory(const std::string& directory)
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex() );
+    cacheDirectory() = directory;
+  }
+
+  void writeCompiledExpressions(
+      const std::string& fileName,
+      const std::vector<std::string>& headers)
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex() );
+    std::ofstream output(fileName);
+    if (!output)
+      throw std::runtime_error("Failed to open '" + fileName + "' for writing");
+    output << "// Generated by RDFAnalysis::writeCompiledExpressions\n"
+      << "#include \"RDFAnalysis/CompiledExpression.h\"\n"
+      << "#include <ROOT/RDataFrame.hxx>\n";
+    for (const std::string& header : headers)
+      output << "#include " << header << "\n";
+    output << "\nnamespace {\n";
+    for (const auto& compiledPair : cache() )
+      output << compiledPair.second.code;
+    output << "\n  struct Register {\n"
+      << "    Register() {\n";
+    for (const auto& compiledPair : cache() ) {
+      const Compiled& compiled = compiledPair.second;
+      std::vector<std::string> extra;
+      extra.reserve(compiled.extraColumns.size() );
+      for (const std::string& column : compiled.extraColumns)
+        extra.push_back("\"" + column + "\"");
+      output << "      RDFAnalysis::detail::registerCompiledExpression(\n"
+        << "          " << rawLiteral(compiledPair.first) << ",\n"
+        << "          &" << compiled.function << ",\n"
+        << "          {" << boost::algorithm::join(extra, ", ") << "},\n"
+        << "          \"" << compiled.function << "\",\n"
+        << "          " << rawLiteral(compiled.code) << ");\n";
+    }
+    output << "    }\n"
+      << "  } theRegister;\n"
+      << "} //> end anonymous namespace\n";
+    if (!output)
+      throw std::runtime_error("Failed to write '" + fileName + "'");
+  }
+} //> end namespace RDFAnalysis
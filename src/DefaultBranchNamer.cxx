@@ -8,23 +8,21 @@
 namespace RDFAnalysis {
   std::string DefaultBranchNamer::nameBranch(
       const std::string& branch,
-      const std::string& systNameIn) const
+      SysID_t syst) const
   {
-    std::string systName = systNameIn.empty() ? m_nominalName : systNameIn;
-    if (std::find(m_systematics.begin(), m_systematics.end(), systName)
-        == m_systematics.end() ) {
-      throw std::out_of_range("Unknown variation " + systName);
-    }
+    if (syst >= registry().size() )
+      throw std::out_of_range("Unknown variation " + std::to_string(syst) );
     auto branchItr = m_branches.find(branch);
     if (branchItr == m_branches.end() )
       throw std::out_of_range(
           "Branch " + branch + " requested but this branch does not exist!");
     // Look for this variation of the branch
-    auto systItr = branchItr->second.find(systName);
-    if (systItr == branchItr->second.end() ) {
+    const std::map<SysID_t, std::string>& columns = branchItr->second.columns;
+    auto systItr = columns.find(syst);
+    if (systItr == columns.end() ) {
       // If it doesn't exist, look for the nominal
-      systItr = branchItr->second.find(m_nominalName);
-      if (systItr == branchItr->second.end() )
+      systItr = columns.find(SystematicRegistry::nominalID);
+      if (systItr == columns.end() )
         throw std::out_of_range(
             "No nominal variation exists for branch " + branch );
     }
@@ -33,67 +31,46 @@ namespace RDFAnalysis {
 
   std::string DefaultBranchNamer::createBranch(
       const std::string& branch,
-      const std::string& systNameIn)
+      SysID_t syst)
   {
-    std::string systName = systNameIn.empty() ? m_nominalName : systNameIn;
-    if (std::find(m_systematics.begin(), m_systematics.end(), systName)
-        == m_systematics.end() ) {
-      throw std::out_of_range("Unknown variation " + systName);
-    }
-    auto branchItr = m_branches.find(branch);
-    if (branchItr == m_branches.end() ) {
-      std::string newBranch = newBranchName(branch, systName);
-      m_branches[branch][systName] = newBranch;
-      return newBranch;
-    }
-    // Look for this variation of the branch
-    auto systItr = branchItr->second.find(systName);
-    if (systItr == branchItr->second.end() ) {
-      std::string newBranch = newBranchName(branch, systName);
-      branchItr->second[systName] = newBranch;
-      return newBranch;
-    }
-    else 
+    const std::string& systName = registry().name(syst);
+    if (exists(branch, syst) )
       throw std::runtime_error("Trying to create variation " + systName +
           " of branch " + branch + " but this already exists!");
-    return "";
+    std::string newBranch = newBranchName(branch, systName);
+    addVariation(branch, syst, newBranch);
+    return newBranch;
   }
 
   bool DefaultBranchNamer::exists(
       const std::string& branch,
-      const std::string& systNameIn) const
+      SysID_t syst) const
   {
-    std::string systName = systNameIn.empty() ? m_nominalName : systNameIn;
     auto branchItr = m_branches.find(branch);
     if (branchItr == m_branches.end() )
       return false;
-    auto systItr = branchItr->second.find(systName);
-    return systItr != branchItr->second.end();
+    return branchItr->second.columns.count(syst) == 1;
   }
 
   std::string DefaultBranchNamer::newBranchName(
       const std::string& branch,
       const std::string& systNameIn) const
   {
-    std::string systName = systNameIn.empty() ? m_nominalName : systNameIn;
+    std::string systName = systNameIn.empty() ? nominalName() : systNameIn;
     if (m_systNameFirst)
       return systName + "_" + branch;
     else
       return branch + "_" + systName;
   }
 
-  std::set<std::string> DefaultBranchNamer::systematicsAffecting(
+  SystematicMask DefaultBranchNamer::affectingMask(
       const std::string& branch) const
   {
     auto itr = m_branches.find(branch);
     if (itr == m_branches.end() )
       return {};
-    else {
-      std::set<std::string> systs;
-      for (const auto& systPair : itr->second)
-        systs.insert(systPair.first);
-      return systs;
-    }
+    else
+      return itr->second.affecting;
   }
 
   std::vector<std::string> DefaultBranchNamer::branches() const
@@ -105,11 +82,11 @@ namespace RDFAnalysis {
   }
 
   void DefaultBranchNamer::readBranchList(
-      const std::map<std::string, RNode>& rnodes)
+      const std::map<SysID_t, RNode>& rnodes)
   {
     // Clear our current branches
     m_branches.clear();
-    std::string fullSystPattern = boost::algorithm::join(m_systematics, "|");
+    std::string fullSystPattern = boost::algorithm::join(systematics(), "|");
     std::regex inputPattern(m_inputFromFriendTrees 
       ? "^("+fullSystPattern+")\\.(\\w+)$"
       : (m_systNameFirst 
@@ -129,12 +106,24 @@ namespace RDFAnalysis {
       for (const std::string& column : rnode.GetColumnNames() ) {
         std::smatch sm;
         if (std::regex_match(column, sm, inputPattern) )
-          m_branches[sm[inputBranchIndex]][sm[inputSystIndex]] = column;
+          addVariation(
+              sm[inputBranchIndex], registry().id(sm[inputSystIndex]), column);
         else if (std::regex_match(column, sm, internalPattern) )
-          m_branches[sm[internalBranchIndex]][sm[internalSystIndex]] = column;
+          addVariation(
+              sm[internalBranchIndex], registry().id(sm[internalSystIndex]), column);
         else
-          m_branches[column][rnodePair.first] = column;
+          addVariation(column, rnodePair.first, column);
       }
     }
   }
+
+  void DefaultBranchNamer::addVariation(
+      const std::string& branch,
+      SysID_t syst,
+      const std::string& column)
+  {
+    BranchVariations& variations = m_branches[branch];
+    variations.columns[syst] = column;
+    variations.affecting.set(syst);
+  }
 } //> end namespace RDFAnalysis
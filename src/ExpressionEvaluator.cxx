@@ -0,0 +1,750 @@
+#include "RDFAnalysis/ExpressionEvaluator.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace {
+  using RNode = ROOT::RDF::RNode;
+  using ColumnNames_t = std::vector<std::string>;
+
+  /// The largest number of columns in a supported expression
+  constexpr std::size_t maxColumns = 8;
+  /// The largest stack that a supported expression may need
+  constexpr std::size_t maxDepth = 32;
+
+  /// The C++ types that a (sub)expression can have
+  enum class Type { Bool, Int, Float, Double, Other };
+
+  /// The operations in an expression
+  enum class Op {
+    Constant, Column,
+    // Unary operations
+    Neg, Not, Abs, Sqrt, Exp, Log, Convert,
+    // Binary operations
+    Add, Sub, Mul, Div, IntDiv, Mod, Pow,
+    Lt, Le, Gt, Ge, Eq, Ne, And, Or
+  };
+
+  /// Thrown by the parser on anything outside of the supported subset
+  struct Unsupported {};
+
+  /// Whether an operation takes one argument
+  bool isUnary(Op op)
+  {
+    return op >= Op::Neg && op <= Op::Convert;
+  }
+
+  /// Apply an operation to its arguments
+  double apply(Op op, double a, double b)
+  {
+    switch (op) {
+      case Op::Neg: return -a;
+      case Op::Not: return !a;
+      case Op::Abs: return std::abs(a);
+      case Op::Sqrt: return std::sqrt(a);
+      case Op::Exp: return std::exp(a);
+      case Op::Log: return std::log(a);
+      case Op::Convert: return a;
+      case Op::Add: return a + b;
+      case Op::Sub: return a - b;
+      case Op::Mul: return a * b;
+      case Op::Div: return a / b;
+      case Op::IntDiv: return std::trunc(a / b);
+      case Op::Mod: return std::fmod(a, b);
+      case Op::Pow: return std::pow(a, b);
+      case Op::Lt: return a < b;
+      case Op::Le: return a <= b;
+      case Op::Gt: return a > b;
+      case Op::Ge: return a >= b;
+      case Op::Eq: return a == b;
+      case Op::Ne: return a != b;
+      case Op::And: return a && b;
+      case Op::Or: return a || b;
+      default: throw std::logic_error("Cannot apply a constant or column");
+    }
+  }
+
+  /// The type of a column, from its name as given by RNode::GetColumnType
+  Type columnType(const std::string& name)
+  {
+    if (name == "double" || name == "Double_t")
+      return Type::Double;
+    if (name == "float" || name == "Float_t")
+      return Type::Float;
+    if (name == "int" || name == "Int_t")
+      return Type::Int;
+    if (name == "bool" || name == "Bool_t")
+      return Type::Bool;
+    return Type::Other;
+  }
+
+  /// The type of an arithmetic operation, following the usual arithmetic
+  /// conversions
+  Type promote(Type lhs, Type rhs)
+  {
+    if (lhs == Type::Double || rhs == Type::Double)
+      return Type::Double;
+    if (lhs == Type::Float || rhs == Type::Float)
+      return Type::Float;
+    return Type::Int;
+  }
+
+  /// A parsed (sub)expression
+  struct Expr {
+    Op op;
+    Type type;
+    /// The value of a constant
+    double value;
+    /// The index of a column
+    std::size_t index;
+    std::vector<std::unique_ptr<Expr>> args;
+  };
+  using ExprPtr = std::unique_ptr<Expr>;
+
+  /// Round a value that should have been calculated as a float
+  double round(Type type, double value)
+  {
+    return type == Type::Float ? static_cast<float>(value) : value;
+  }
+
+  ExprPtr constant(Type type, double value)
+  {
+    return ExprPtr(new Expr{Op::Constant, type, round(type, value), 0, {}});
+  }
+
+  /// Create an operation, folding it if all of its arguments are constant
+  ExprPtr operation(Op op, Type type, ExprPtr lhs, ExprPtr rhs = nullptr)
+  {
+    if (lhs->op == Op::Constant && (!rhs || rhs->op == Op::Constant) )
+      return constant(type, apply(op, lhs->value, rhs ? rhs->value : 0) );
+    ExprPtr expr(new Expr{op, type, 0, 0, {}});
+    expr->args.push_back(std::move(lhs) );
+    if (rhs)
+      expr->args.push_back(std::move(rhs) );
+    return expr;
+  }
+
+  /// Convert an operand to the type of the operation using it. Only
+  /// conversions to float change the value.
+  ExprPtr convert(ExprPtr expr, Type type)
+  {
+    if (type == Type::Float && expr->type != Type::Float)
+      return operation(Op::Convert, Type::Float, std::move(expr) );
+    return expr;
+  }
+
+  /**
+   * @brief Parser for the supported subset of C++ expressions
+   *
+   * Each level of the grammar follows the C++ operator precedence. Anything
+   * else makes the parser throw Unsupported.
+   */
+  class Parser {
+    public:
+      Parser(const std::string& text, const std::vector<Type>& types) :
+        m_text(text), m_types(types) {}
+
+      ExprPtr parse()
+      {
+        ExprPtr expr = parseOr();
+        skipSpace();
+        if (m_pos != m_text.size() )
+          throw Unsupported();
+        return expr;
+      }
+
+    private:
+      const std::string& m_text;
+      const std::vector<Type>& m_types;
+      std::size_t m_pos = 0;
+
+      void skipSpace()
+      {
+        while (m_pos < m_text.size() && std::isspace(m_text[m_pos]) )
+          ++m_pos;
+      }
+
+      char peek(std::size_t offset = 0) const
+      {
+        return m_pos + offset < m_text.size() ? m_text[m_pos + offset] : '\0';
+      }
+
+      /// Consume a token if it is next, unless it is followed by a character
+      /// that would make it a different operator
+      bool accept(const std::string& token, const std::string& notFollowedBy = "")
+      {
+        skipSpace();
+        if (m_text.compare(m_pos, token.size(), token) != 0)
+          return false;
+        char next = peek(token.size() );
+        if (next != '\0' && notFollowedBy.find(next) != std::string::npos)
+          return false;
+        m_pos += token.size();
+        return true;
+      }
+
+      void expect(const std::string& token)
+      {
+        if (!accept(token) )
+          throw Unsupported();
+      }
+
+      ExprPtr logical(Op op, ExprPtr lhs, ExprPtr rhs)
+      {
+        return operation(op, Type::Bool, std::move(lhs), std::move(rhs) );
+      }
+
+      ExprPtr arithmetic(Op op, ExprPtr lhs, ExprPtr rhs)
+      {
+        Type type = promote(lhs->type, rhs->type);
+        if (op == Op::Mod && type != Type::Int)
+          throw Unsupported();
+        if (op == Op::Div && type == Type::Int)
+          op = Op::IntDiv;
+        return operation(op, type,
+            convert(std::move(lhs), type),
+            convert(std::move(rhs), type) );
+      }
+
+      ExprPtr comparison(Op op, ExprPtr lhs, ExprPtr rhs)
+      {
+        Type type = promote(lhs->type, rhs->type);
+        return operation(op, Type::Bool,
+            convert(std::move(lhs), type),
+            convert(std::move(rhs), type) );
+      }
+
+      ExprPtr parseOr()
+      {
+        ExprPtr expr = parseAnd();
+        while (accept("||") )
+          expr = logical(Op::Or, std::move(expr), parseAnd() );
+        return expr;
+      }
+
+      ExprPtr parseAnd()
+      {
+        ExprPtr expr = parseEquality();
+        while (accept("&&") )
+          expr = logical(Op::And, std::move(expr), parseEquality() );
+        return expr;
+      }
+
+      ExprPtr parseEquality()
+      {
+        ExprPtr expr = parseRelational();
+        while (true) {
+          if (accept("=="))
+            expr = comparison(Op::Eq, std::move(expr), parseRelational() );
+          else if (accept("!="))
+            expr = comparison(Op::Ne, std::move(expr), parseRelational() );
+          else
+            return expr;
+        }
+      }
+
+      ExprPtr parseRelational()
+      {
+        ExprPtr expr = parseAdditive();
+        while (true) {
+          if (accept("<="))
+            expr = comparison(Op::Le, std::move(expr), parseAdditive() );
+          else if (accept(">="))
+            expr = comparison(Op::Ge, std::move(expr), parseAdditive() );
+          else if (accept("<", "<"))
+            expr = comparison(Op::Lt, std::move(expr), parseAdditive() );
+          else if (accept(">", ">"))
+            expr = comparison(Op::Gt, std::move(expr), parseAdditive() );
+          else
+            return expr;
+        }
+      }
+
+      ExprPtr parseAdditive()
+      {
+        ExprPtr expr = parseMultiplicative();
+        while (true) {
+          if (accept("+", "+="))
+            expr = arithmetic(Op::Add, std::move(expr), parseMultiplicative() );
+          else if (accept("-", "-=>"))
+            expr = arithmetic(Op::Sub, std::move(expr), parseMultiplicative() );
+          else
+            return expr;
+        }
+      }
+
+      ExprPtr parseMultiplicative()
+      {
+        ExprPtr expr = parseUnary();
+        while (true) {
+          if (accept("*", "="))
+            expr = arithmetic(Op::Mul, std::move(expr), parseUnary() );
+          else if (accept("/", "="))
+            expr = arithmetic(Op::Div, std::move(expr), parseUnary() );
+          else if (accept("%", "="))
+            expr = arithmetic(Op::Mod, std::move(expr), parseUnary() );
+          else
+            return expr;
+        }
+      }
+
+      ExprPtr parseUnary()
+      {
+        if (accept("!", "="))
+          return operation(Op::Not, Type::Bool, parseUnary() );
+        if (accept("-", "-=>")) {
+          ExprPtr expr = parseUnary();
+          Type type = promote(expr->type, Type::Int);
+          return operation(Op::Neg, type, convert(std::move(expr), type) );
+        }
+        if (accept("+", "+=")) {
+          ExprPtr expr = parseUnary();
+          Type type = promote(expr->type, Type::Int);
+          return operation(Op::Convert, type, std::move(expr) );
+        }
+        return parsePrimary();
+      }
+
+      ExprPtr parsePrimary()
+      {
+        skipSpace();
+        if (accept("(") ) {
+          ExprPtr expr = parseOr();
+          expect(")");
+          return expr;
+        }
+        if (accept("{") )
+          return parseColumn();
+        char next = peek();
+        if (std::isdigit(next) || (next == '.' && std::isdigit(peek(1) ) ) )
+          return parseNumber();
+        if (std::isalpha(next) || next == '_')
+          return parseIdentifier();
+        throw Unsupported();
+      }
+
+      ExprPtr parseColumn()
+      {
+        std::size_t start = m_pos;
+        while (std::isdigit(peek() ) )
+          ++m_pos;
+        if (m_pos == start || peek() != '}')
+          throw Unsupported();
+        std::size_t index = std::stoul(m_text.substr(start, m_pos - start) );
+        ++m_pos;
+        if (index >= m_types.size() || m_types.at(index) == Type::Other)
+          throw Unsupported();
+        return ExprPtr(new Expr{Op::Column, m_types.at(index), 0, index, {}});
+      }
+
+      ExprPtr parseNumber()
+      {
+        std::size_t start = m_pos;
+        bool floating = false;
+        while (std::isdigit(peek() ) )
+          ++m_pos;
+        if (peek() == '.') {
+          floating = true;
+          ++m_pos;
+          while (std::isdigit(peek() ) )
+            ++m_pos;
+        }
+        if (peek() == 'e' || peek() == 'E') {
+          floating = true;
+          ++m_pos;
+          if (peek() == '+' || peek() == '-')
+            ++m_pos;
+          if (!std::isdigit(peek() ) )
+            throw Unsupported();
+          while (std::isdigit(peek() ) )
+            ++m_pos;
+        }
+        std::string literal = m_text.substr(start, m_pos - start);
+        // Octal literals are not supported
+        if (!floating && literal.size() > 1 && literal[0] == '0')
+          throw Unsupported();
+        Type type = floating ? Type::Double : Type::Int;
+        if (floating && (peek() == 'f' || peek() == 'F') ) {
+          type = Type::Float;
+          ++m_pos;
+        }
+        // Any other suffix (or a hexadecimal literal)
+        if (std::isalnum(peek() ) || peek() == '_' || peek() == '.')
+          throw Unsupported();
+        return constant(type, std::strtod(literal.c_str(), nullptr) );
+      }
+
+      ExprPtr parseIdentifier()
+      {
+        std::string name;
+        if (accept("std::") )
+          name = "std::";
+        std::size_t start = m_pos;
+        while (std::isalnum(peek() ) || peek() == '_')
+          ++m_pos;
+        name += m_text.substr(start, m_pos - start);
+        if (name == "true" || name == "false")
+          return constant(Type::Bool, name == "true");
+        if (name.compare(0, 5, "std::") == 0)
+          name = name.substr(5);
+        // The remaining identifiers are all functions
+        expect("(");
+        ExprPtr arg = parseOr();
+        if (name == "pow") {
+          expect(",");
+          ExprPtr exponent = parseOr();
+          expect(")");
+          Type type = arg->type == Type::Float && exponent->type == Type::Float ?
+            Type::Float : Type::Double;
+          return operation(Op::Pow, type, std::move(arg), std::move(exponent) );
+        }
+        expect(")");
+        bool isFloat = arg->type == Type::Float;
+        if (name == "abs") {
+          Type type = promote(arg->type, Type::Int);
+          return operation(Op::Abs, type, std::move(arg) );
+        }
+        if (name == "fabs")
+          return operation(Op::Abs, isFloat ? Type::Float : Type::Double, std::move(arg) );
+        if (name == "sqrt")
+          return operation(Op::Sqrt, isFloat ? Type::Float : Type::Double, std::move(arg) );
+        if (name == "exp")
+          return operation(Op::Exp, isFloat ? Type::Float : Type::Double, std::move(arg) );
+        if (name == "log")
+          return operation(Op::Log, isFloat ? Type::Float : Type::Double, std::move(arg) );
+        throw Unsupported();
+      }
+  }; //> end class Parser
+
+  /// A parsed expression, stored as a program for a stack machine
+  class Program {
+    public:
+      Program(const Expr& expr) : m_type(expr.type)
+      {
+        std::size_t depth = 0;
+        emit(expr, depth);
+      }
+
+      /// The type of the expression
+      Type type() const { return m_type; }
+
+      /// Evaluate the expression on a set of column values
+      double evaluate(const double* inputs) const
+      {
+        std::array<double, maxDepth> stack;
+        std::size_t size = 0;
+        for (const Instruction& instruction : m_code) {
+          switch (instruction.op) {
+            case Op::Constant:
+              stack[size++] = instruction.value;
+              break;
+            case Op::Column:
+              stack[size++] = inputs[instruction.index];
+              break;
+            default:
+              if (isUnary(instruction.op) )
+                stack[size-1] = apply(instruction.op, stack[size-1], 0);
+              else {
+                --size;
+                stack[size-1] = apply(instruction.op, stack[size-1], stack[size]);
+              }
+              if (instruction.toFloat)
+                stack[size-1] = static_cast<float>(stack[size-1]);
+          }
+        }
+        return stack[0];
+      }
+
+    private:
+      struct Instruction {
+        Op op;
+        /// Whether the result is rounded to a float
+        bool toFloat;
+        double value;
+        std::size_t index;
+      };
+      std::vector<Instruction> m_code;
+      Type m_type;
+
+      /// Write the instructions for an expression, which leaves its result on
+      /// top of the stack
+      void emit(const Expr& expr, std::size_t& depth)
+      {
+        std::size_t start = depth;
+        for (const ExprPtr& arg : expr.args)
+          emit(*arg, depth);
+        if (expr.args.empty() && ++depth > maxDepth)
+          throw Unsupported();
+        depth = start + 1;
+        m_code.push_back(Instruction{
+            expr.op, expr.type == Type::Float, expr.value, expr.index});
+      }
+  }; //> end class Program
+
+  /// Everything parsed so far. Unsupported expressions are stored as null.
+  std::map<std::string, std::shared_ptr<const Program>>& programs()
+  {
+    static std::map<std::string, std::shared_ptr<const Program>> thePrograms;
+    return thePrograms;
+  }
+
+  std::mutex& programMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  /// Get the program for an expression template, if it is supported
+  std::shared_ptr<const Program> getProgram(
+      RNode& rnode,
+      const std::string& expression,
+      const ColumnNames_t& columns,
+      bool filter,
+      std::vector<Type>& types)
+  {
+    types.clear();
+    std::string key = expression;
+    for (const std::string& column : columns) {
+      std::string type = rnode.GetColumnType(column);
+      types.push_back(columnType(type) );
+      key += ":" + type;
+    }
+    std::shared_ptr<const Program> program;
+    {
+      std::lock_guard<std::mutex> lock(programMutex() );
+      auto itr = programs().find(key);
+      if (itr == programs().end() ) {
+        if (columns.size() <= maxColumns) {
+          try {
+            program = std::make_shared<const Program>(*Parser(expression, types).parse() );
+          }
+          catch (const Unsupported&) {}
+        }
+        programs()[key] = program;
+      }
+      else
+        program = itr->second;
+    }
+    // A new column must have the same type as if the interpreter had made it
+    if (program && !filter && program->type() == Type::Int)
+      return nullptr;
+    return program;
+  }
+
+  template <typename T, std::size_t>
+    using Input_t = const T&;
+
+  /// The functor evaluating a program on N columns of type T
+  template <typename R, typename T, typename Seq>
+    class Evaluate;
+
+  template <typename R, typename T, std::size_t... I>
+    class Evaluate<R, T, std::index_sequence<I...>> {
+      public:
+        Evaluate(std::shared_ptr<const Program> program) :
+          m_program(std::move(program) ) {}
+
+        R operator()(Input_t<T, I>... values) const
+        {
+          // The extra element allows for expressions without any columns
+          const double inputs[] = {static_cast<double>(values)..., 0.};
+          return static_cast<R>(m_program->evaluate(inputs) );
+        }
+
+      private:
+        std::shared_ptr<const Program> m_program;
+    }; //> end class Evaluate
+
+  template <typename R, typename T>
+    RNode defineN(
+        RNode&,
+        const std::string&,
+        const ColumnNames_t&,
+        std::shared_ptr<const Program>,
+        std::integral_constant<std::size_t, maxColumns + 1>)
+    {
+      throw std::logic_error("Too many columns for an evaluated expression");
+    }
+
+  template <typename R, typename T, std::size_t N>
+    RNode defineN(
+        RNode& rnode,
+        const std::string& name,
+        const ColumnNames_t& columns,
+        std::shared_ptr<const Program> program,
+        std::integral_constant<std::size_t, N>)
+    {
+      if (columns.size() == N)
+        return rnode.Define(
+            name, Evaluate<R, T, std::make_index_sequence<N>>(program), columns);
+      return defineN<R, T>(
+          rnode, name, columns, program,
+          std::integral_constant<std::size_t, N + 1>{});
+    }
+
+  template <typename T>
+    RNode filterN(
+        RNode&,
+        const std::string&,
+        const ColumnNames_t&,
+        std::shared_ptr<const Program>,
+        std::integral_constant<std::size_t, maxColumns + 1>)
+    {
+      throw std::logic_error("Too many columns for an evaluated expression");
+    }
+
+  template <typename T, std::size_t N>
+    RNode filterN(
+        RNode& rnode,
+        const std::string& filterName,
+        const ColumnNames_t& columns,
+        std::shared_ptr<const Program> program,
+        std::integral_constant<std::size_t, N>)
+    {
+      if (columns.size() == N)
+        return rnode.Filter(
+            Evaluate<bool, T, std::make_index_sequence<N>>(program),
+            columns, filterName);
+      return filterN<T>(
+          rnode, filterName, columns, program,
+          std::integral_constant<std::size_t, N + 1>{});
+    }
+
+  /// Define a double copy of a column
+  template <typename T>
+    RNode defineAsDouble(RNode& rnode, const std::string& name, const std::string& column)
+    {
+      return rnode.Define(name, [] (const T& value) -> double { return value; }, {column});
+    }
+
+  /**
+   * @brief Make sure that the inputs of a program all have the same type
+   * @param rnode The RNode holding the columns. Extra columns are defined on
+   * it if necessary.
+   * @param columns The columns. Converted columns are replaced.
+   * @param types The types of the columns
+   * @return The common type of the columns
+   *
+   * If all the columns are floats or all are doubles they are used directly,
+   * otherwise any column that is not a double is copied into a new double
+   * column.
+   */
+  Type unifyInputs(RNode& rnode, ColumnNames_t& columns, const std::vector<Type>& types)
+  {
+    bool allFloat = true;
+    for (Type type : types)
+      allFloat &= type == Type::Float;
+    if (allFloat)
+      return Type::Float;
+    ColumnNames_t existing = rnode.GetColumnNames();
+    for (std::size_t idx = 0; idx < columns.size(); ++idx) {
+      if (types.at(idx) == Type::Double)
+        continue;
+      // Encode anything that cannot appear in a column name
+      std::string name = "RDFAnalysis_double_";
+      for (char c : columns.at(idx) ) {
+        if (std::isalnum(c) )
+          name += c;
+        else {
+          char encoded[4];
+          std::snprintf(encoded, sizeof(encoded), "_%02x", static_cast<unsigned char>(c) );
+          name += encoded;
+        }
+      }
+      if (std::find(existing.begin(), existing.end(), name) == existing.end() ) {
+        switch (types.at(idx) ) {
+          case Type::Float:
+            rnode = defineAsDouble<float>(rnode, name, columns.at(idx) );
+            break;
+          case Type::Int:
+            rnode = defineAsDouble<int>(rnode, name, columns.at(idx) );
+            break;
+          case Type::Bool:
+            rnode = defineAsDouble<bool>(rnode, name, columns.at(idx) );
+            break;
+          default:
+            throw std::logic_error("Unexpected column type");
+        }
+        existing.push_back(name);
+      }
+      columns.at(idx) = name;
+    }
+    return Type::Double;
+  }
+} //> end anonymous namespace
+
+namespace RDFAnalysis { namespace detail {
+  bool canEvaluate(
+      ROOT::RDF::RNode& rnode,
+      const std::string& expression,
+      const std::vector<std::string>& columns,
+      bool filter)
+  {
+    std::vector<Type> types;
+    return getProgram(rnode, expression, columns, filter, types) != nullptr;
+  }
+
+  bool defineEvaluated(
+      ROOT::RDF::RNode& rnode,
+      ROOT::RDF::RNode& output,
+      const std::string& name,
+      const std::string& expression,
+      const std::vector<std::string>& columns)
+  {
+    std::vector<Type> types;
+    std::shared_ptr<const Program> program = getProgram(
+        rnode, expression, columns, false, types);
+    if (!program)
+      return false;
+    RNode input = rnode;
+    ColumnNames_t inputs = columns;
+    bool floatInputs = unifyInputs(input, inputs, types) == Type::Float;
+    std::integral_constant<std::size_t, 0> first;
+    switch (program->type() ) {
+      case Type::Bool:
+        output = floatInputs ?
+          defineN<bool, float>(input, name, inputs, program, first) :
+          defineN<bool, double>(input, name, inputs, program, first);
+        break;
+      case Type::Float:
+        output = floatInputs ?
+          defineN<float, float>(input, name, inputs, program, first) :
+          defineN<float, double>(input, name, inputs, program, first);
+        break;
+      default:
+        output = floatInputs ?
+          defineN<double, float>(input, name, inputs, program, first) :
+          defineN<double, double>(input, name, inputs, program, first);
+    }
+    return true;
+  }
+
+  bool filterEvaluated(
+      ROOT::RDF::RNode& rnode,
+      ROOT::RDF::RNode& output,
+      const std::string& expression,
+      const std::vector<std::string>& columns,
+      const std::string& filterName)
+  {
+    std::vector<Type> types;
+    std::shared_ptr<const Program> program = getProgram(
+        rnode, expression, columns, true, types);
+    if (!program)
+      return false;
+    RNode input = rnode;
+    ColumnNames_t inputs = columns;
+    std::integral_constant<std::size_t, 0> first;
+    output = unifyInputs(input, inputs, types) == Type::Float ?
+      filterN<float>(input, filterName, inputs, program, first) :
+      filterN<double>(input, filterName, inputs, program, first);
+    return true;
+  }
+} } //> end namespace RDFAnalysis::detail
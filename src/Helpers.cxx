@@ -1,8 +1,49 @@
 #include "RDFAnalysis/Helpers.h"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace RDFAnalysis {
   std::string uniqueBranchName(const std::string& stub) {
     static unsigned int n = 0;
     return "_"+stub+std::to_string(n++)+"_";
   }
+
+  bool writeFileAtomically(
+      const std::string& fileName,
+      const std::function<void(std::ostream&)>& write)
+  {
+    // The temporary file is in the same directory so that the rename is
+    // atomic
+    std::string pattern = fileName + ".XXXXXX";
+    std::vector<char> tmpName(pattern.begin(), pattern.end() );
+    tmpName.push_back('\0');
+    int fd = mkstemp(tmpName.data() );
+    if (fd == -1)
+      throw std::runtime_error("Failed to create a temporary file for " + fileName);
+    // mkstemp only makes the file readable by its owner
+    fchmod(fd, 0644);
+    close(fd);
+    try {
+      std::ofstream os(tmpName.data() );
+      if (!os)
+        throw std::runtime_error("Failed to open " + std::string(tmpName.data() ) );
+      write(os);
+      os.close();
+      if (!os)
+        throw std::runtime_error("Failed to write " + std::string(tmpName.data() ) );
+    }
+    catch (...) {
+      std::remove(tmpName.data() );
+      throw;
+    }
+    if (std::rename(tmpName.data(), fileName.c_str() ) != 0) {
+      std::remove(tmpName.data() );
+      return false;
+    }
+    return true;
+  }
 } //> end namespace RDFAnalysis
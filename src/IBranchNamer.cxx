@@ -5,25 +5,32 @@
 
 namespace RDFAnalysis {
 
+  IBranchNamer::IBranchNamer(
+      const std::string& nominalName,
+      const std::vector<std::string>& systematics) :
+    m_registry(std::make_shared<SystematicRegistry>(nominalName) )
+  {
+    for (const std::string& syst : systematics)
+      m_registry->intern(syst);
+  }
+
   std::vector<std::string> IBranchNamer::nameBranches(
       const std::vector<std::string>& branches,
-      const std::string& systName) const
+      SysID_t syst) const
   {
     std::vector<std::string> out;
     out.reserve(branches.size() );
     for (const std::string& branch : branches)
-      out.push_back(nameBranch(branch, systName) );
+      out.push_back(nameBranch(branch, syst) );
     return out;
   }
 
-  std::set<std::string> IBranchNamer::systematicsAffecting(
+  SystematicMask IBranchNamer::affectingMask(
       const std::vector<std::string>& branches) const
   {
-    std::set<std::string> allAffecting;
-    for (const std::string& branch : branches) {
-      std::set<std::string> affecting = systematicsAffecting(branch);
-      allAffecting.insert(affecting.begin(), affecting.end() );
-    }
+    SystematicMask allAffecting;
+    for (const std::string& branch : branches)
+      allAffecting |= affectingMask(branch);
     return allAffecting;
   }
 
@@ -58,7 +65,7 @@ namespace RDFAnalysis {
   std::string IBranchNamer::interpretExpression(
       const std::string& expression,
       const std::vector<std::string>& branches,
-      const std::string& systematic)
+      SysID_t syst)
   {
     std::regex regexpr("\\{(\\d+)\\}");
     std::string newExp = expression;
@@ -66,7 +73,7 @@ namespace RDFAnalysis {
     while (std::regex_search(newExp, sm, regexpr) ) {
       std::size_t idx = std::stoi(sm.str(1) );
       std::string branch = branches.at(idx);
-      std::string systBranch = nameBranch(branch, systematic);
+      std::string systBranch = nameBranch(branch, syst);
       boost::algorithm::replace_all(newExp, sm.str(0), systBranch);
     }
     return newExp;
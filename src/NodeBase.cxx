@@ -1,5 +1,45 @@
 #include "RDFAnalysis/NodeBase.h"
+#include "RDFAnalysis/CompiledExpression.h"
 #include <typeinfo>
+#include <stdexcept>
+#include <regex>
+#include <algorithm>
+
+namespace {
+  /**
+   * @brief Define a vector of doubles holding the value(s) of a column
+   * @param rnode The RNode holding the column, updated with the new one
+   * @param name The name of the new column
+   * @param input The column to convert
+   *
+   * Containers are converted element by element, as in RNode::Fill. Known
+   * column types are converted by a typed action, anything else needs the
+   * interpreter.
+   */
+  void defineDoubles(
+      ROOT::RDF::RNode& rnode,
+      const std::string& name,
+      const std::string& input)
+  {
+    std::string type = rnode.GetColumnType(input);
+    bool typed = RDFAnalysis::detail::visitColumnType(type,
+        [&] (auto tag) {
+          using T = typename decltype(tag)::type;
+          rnode = rnode.Define(
+              name,
+              [] (const T& value) { return RDFAnalysis::detail::ToDoubles<T>::convert(value); },
+              {input});
+        });
+    if (typed)
+      return;
+    static const std::regex containerRegex("(^|::)(RVec|vector|array)<");
+    rnode = rnode.Define(
+        name,
+        std::regex_search(type, containerRegex) ?
+          "ROOT::RVec<double>(" + input + ".begin(), " + input + ".end())" :
+          "ROOT::RVec<double>{static_cast<double>(" + input + ")}");
+  }
+} //> end anonymous namespace
 
 namespace RDFAnalysis {
   NodeBase* NodeBase::Define(
@@ -18,16 +58,131 @@ namespace RDFAnalysis {
     // We don't actually use the output of the action so we don't store it.
     // However we need there to be a return value for the lambda.
     // Note that this action updates the node passed in.
+    // The expression is compiled once and each variation only changes the
+    // columns passed to it
     Act(
-       [] (RNode& rnode, const std::string& name, const std::string& expression) {
-        return rnode = rnode.Define(name, expression); },
+       [expression] (RNode& rnode, const std::string& name, const ColumnNames_t& inputs) {
+        return rnode = detail::defineCompiled(rnode, name, expression, inputs); },
         columns,
         SysVarNewBranch(name),
-        SysVarStringExpression(expression, columns) );
+        SysVarBranchVector(columns) );
     return this;
   }
 
-  std::map<std::string, RNode> NodeBase::makeChildRNodes(
+  std::map<SysID_t, std::vector<SysID_t>> NodeBase::variationsByRNode(
+      const ColumnNames_t& columns) const
+  {
+    SystematicMask affecting = m_namer->affectingMask(columns);
+    if (m_backend == SystematicsBackend::Vary)
+      affecting.reset();
+    affecting &= ~m_prunedVariations;
+    std::map<SysID_t, std::vector<SysID_t>> result;
+    for (const auto& rnodePair : m_rnodes) {
+      affecting.reset(rnodePair.first);
+      if (m_prunedVariations.test(rnodePair.first) )
+        continue;
+      result[rnodePair.first].push_back(rnodePair.first);
+    }
+    std::vector<SysID_t>& nominal = result.at(SystematicRegistry::nominalID);
+    for (SysID_t syst = 0; affecting.any(); ++syst) {
+      if (!affecting.test(syst) )
+        continue;
+      affecting.reset(syst);
+      nominal.push_back(syst);
+    }
+    return result;
+  }
+
+  std::vector<SysID_t> NodeBase::weightOnlyVariations(
+      const ColumnNames_t& columns,
+      const std::string& weight) const
+  {
+    std::vector<SysID_t> result;
+    if (m_backend == SystematicsBackend::Vary)
+      return result;
+    SystematicMask affecting = m_namer->affectingMask(weight);
+    affecting &= ~m_namer->affectingMask(columns);
+    affecting &= ~m_prunedVariations;
+    for (const auto& rnodePair : m_rnodes)
+      affecting.reset(rnodePair.first);
+    for (SysID_t syst = 0; affecting.any(); ++syst) {
+      if (!affecting.test(syst) )
+        continue;
+      affecting.reset(syst);
+      result.push_back(syst);
+    }
+    return result;
+  }
+
+  std::string NodeBase::weightVector(
+      const std::string& weight,
+      const std::vector<SysID_t>& systs)
+  {
+    auto key = std::make_pair(weight, systs);
+    auto itr = m_weightVectors.find(key);
+    if (itr != m_weightVectors.end() )
+      return itr->second;
+    std::vector<std::string> weights;
+    weights.reserve(systs.size() );
+    for (SysID_t syst : systs)
+      weights.push_back(m_namer->nameBranch(weight, syst) );
+    std::string name = uniqueBranchName("WeightVector");
+    RNode& nominal = m_rnodes.at(SystematicRegistry::nominalID);
+    // Weights are packed by a typed action if they are all doubles or all
+    // floats, as in TypedFill, otherwise the interpreter has to do it
+    std::string type = detail::normalizeColumnType(nominal.GetColumnType(weights.front() ) );
+    bool sameType = std::all_of(weights.begin(), weights.end(),
+        [&nominal, &type] (const std::string& column)
+        { return detail::normalizeColumnType(nominal.GetColumnType(column) ) == type; });
+    if (sameType && type == "double")
+      detail::packColumns<detail::ToDouble<double>>(nominal, weights, name);
+    else if (sameType && type == "float")
+      detail::packColumns<detail::ToDouble<float>>(nominal, weights, name);
+    else
+      nominal = nominal.Define(
+          name,
+          "ROOT::RVec<double>{" + boost::algorithm::join(weights, ", ") + "}");
+    m_weightVectors.emplace(key, name);
+    return name;
+  }
+
+  std::string NodeBase::doublesColumn(const std::string& column)
+  {
+    auto itr = m_doublesColumns.find(column);
+    if (itr != m_doublesColumns.end() )
+      return itr->second;
+    RNode& nominal = m_rnodes.at(SystematicRegistry::nominalID);
+    std::string input = m_namer->nameBranch(column, SystematicRegistry::nominalID);
+    std::string name = uniqueBranchName("FillValues");
+    defineDoubles(nominal, name, input);
+    m_doublesColumns.emplace(column, name);
+    return name;
+  }
+
+  std::string NodeBase::variedDoublesColumn(
+      const std::string& column,
+      const std::vector<SysID_t>& systs)
+  {
+    auto key = std::make_pair(column, systs);
+    auto itr = m_variedDoublesColumns.find(key);
+    if (itr != m_variedDoublesColumns.end() )
+      return itr->second;
+    RNode& nominal = m_rnodes.at(SystematicRegistry::nominalID);
+    // Each variation is converted on its own and the results are packed
+    // together, so only the conversion depends on the column type
+    std::vector<std::string> values;
+    values.reserve(systs.size() );
+    for (SysID_t syst : systs) {
+      values.push_back(uniqueBranchName("FillValues") );
+      defineDoubles(nominal, values.back(), m_namer->nameBranch(column, syst) );
+    }
+    std::string name = uniqueBranchName("VariedFillValues");
+    detail::packColumns<detail::Copy<ROOT::VecOps::RVec<double>>>(nominal, values, name);
+    m_variedDoublesColumns.emplace(key, name);
+    return name;
+  }
+
+  std::map<SysID_t, RNode> NodeBase::makeChildRNodes(
       const std::string& expression,
       const std::string& cutflowName)
   {
@@ -35,16 +190,16 @@ namespace RDFAnalysis {
     return makeChildRNodes(expanded.first, expanded.second, cutflowName);
   }
 
-  std::map<std::string, RNode> NodeBase::makeChildRNodes(
+  std::map<SysID_t, RNode> NodeBase::makeChildRNodes(
       const std::string& expression,
       const ColumnNames_t& columns,
       const std::string& cutflowName)
   {
     return Act(
-        [] (RNode& rnode, const std::string& expression, const std::string& cutflowName) -> RNode{
-        return rnode.Filter(expression, cutflowName); },
+        [expression] (RNode& rnode, const ColumnNames_t& inputs, const std::string& cutflowName) -> RNode{
+        return detail::filterCompiled(rnode, expression, inputs, cutflowName); },
         columns,
-        SysVarStringExpression(expression, columns),
+        SysVarBranchVector(columns),
         cutflowName);
   }
 
@@ -89,27 +244,33 @@ namespace RDFAnalysis {
       const std::string& name,
       const std::string& cutflowName,
       const std::string& weight,
-      WeightStrategy strategy) :
-    m_rnodes({{namer->nominalName(), rnode}}),
+      WeightStrategy strategy,
+      SystematicsBackend backend) :
+    m_rnodes({{SystematicRegistry::nominalID, rnode}}),
     m_namer(std::move(namer) ),
     m_namerInit(*m_namer, m_rnodes),
+    m_backend(declareVariations(backend) ),
     m_isMC(isMC),
     m_name(name),
     m_cutflowName(cutflowName),
-    m_rootRNode(&m_rnodes.at(m_namer->nominalName() ) ),
+    m_rootRNode(&m_rnodes.at(SystematicRegistry::nominalID) ),
     m_weight(setWeight(weight, nullptr, strategy) )
   {
   }
 
   NodeBase::NodeBase(
       NodeBase& parent,
-      std::map<std::string, RNode>&& rnodes,
+      std::map<SysID_t, RNode>&& rnodes,
       const std::string& name,
       const std::string& cutflowName,
       const std::string& weight,
       WeightStrategy strategy) :
     m_rnodes(std::move(rnodes) ),
     m_namer(parent.namer().copy() ),
+    m_backend(parent.m_backend),
+    m_prunedVariations(parent.m_prunedVariations),
+    m_droppedVariations(parent.m_droppedVariations),
+    m_deltaFill(parent.m_deltaFill),
     m_isMC(parent.isMC() ),
     m_name(name),
     m_cutflowName(cutflowName),
@@ -123,4 +284,53 @@ namespace RDFAnalysis {
     // Construct the name of the node by hashing the pointer
     return "_NodeWeight_"+std::to_string(std::hash<NodeBase*>()(this) )+"_";
   }
+
+  SystematicsBackend NodeBase::declareVariations(SystematicsBackend backend)
+  {
+    if (backend != SystematicsBackend::Vary)
+      return backend;
+#ifdef RDFAnalysis_HAS_VARY
+    RNode& nominal = m_rnodes.at(SystematicRegistry::nominalID);
+    // Collect the input branches that have a variation for each systematic
+    std::map<SysID_t, ColumnNames_t> variedBranches;
+    for (const std::string& branch : m_namer->branches() ) {
+      if (!m_namer->exists(branch, SystematicRegistry::nominalID) )
+        continue;
+      SystematicMask affecting = m_namer->affectingMask(branch);
+      affecting.reset(SystematicRegistry::nominalID);
+      for (SysID_t syst = 0; affecting.any(); ++syst) {
+        if (!affecting.test(syst) )
+          continue;
+        affecting.reset(syst);
+        variedBranches[syst].push_back(branch);
+      }
+    }
+    // Vary can only declare columns of one type together, so make one call
+    // for each type that a systematic varies. All of the calls use the
+    // systematic's name so that RDataFrame still sees a single variation.
+    for (const auto& sysPair : variedBranches) {
+      const std::string& systName = m_namer->registry().name(sysPair.first);
+      std::map<std::string, std::pair<ColumnNames_t, std::vector<std::string>>> byType;
+      for (const std::string& branch : sysPair.second) {
+        std::string column = m_namer->nameBranch(
+            branch, SystematicRegistry::nominalID);
+        auto& typeGroup = byType[nominal.GetColumnType(column)];
+        typeGroup.first.push_back(column);
+        typeGroup.second.push_back(
+            "{" + m_namer->nameBranch(branch, sysPair.first) + "}");
+      }
+      for (const auto& typePair : byType)
+        nominal = nominal.Vary(
+            typePair.second.first,
+            "ROOT::RVec<ROOT::RVec<" + typePair.first + ">>{" +
+              boost::algorithm::join(typePair.second.second, ", ") + "}",
+            {"var"},
+            systName);
+    }
+    return backend;
+#else
+    throw std::logic_error(
+        "The Vary systematics backend requires ROOT 6.26 or newer");
+#endif
+  }
 }; //> enad namespace RDFAnalysis
@@ -1,9 +1,22 @@
 #include "RDFAnalysis/SchedulerBase.h"
+#include "RDFAnalysis/Helpers.h"
 #include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <regex>
 #include "RDFAnalysis/Utils/BoostGraphBuilder.h"
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/graphviz.hpp>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 
 namespace {
 
@@ -56,6 +69,351 @@ namespace {
     private:
       prop_map_t m_propMap;
   };
+
+  /// Hash a set of action IDs
+  std::size_t hashActions(const boost::dynamic_bitset<>& actions)
+  {
+    std::size_t seed = actions.count();
+    for (std::size_t idx = actions.find_first();
+        idx != boost::dynamic_bitset<>::npos;
+        idx = actions.find_next(idx) )
+      // Same mixing as boost::hash_combine
+      seed ^= idx + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    return seed;
+  }
+
+  /// 64 bit FNV-1a hash. Unlike std::hash this is the same for every build so
+  /// can be written to file.
+  class StableHash {
+    public:
+      void add(unsigned char byte)
+      {
+        m_value ^= byte;
+        m_value *= 1099511628211ull;
+      }
+      void add(std::uint64_t value)
+      {
+        for (std::size_t idx = 0; idx < 8; ++idx)
+          add(static_cast<unsigned char>(value >> (8*idx) ) );
+      }
+      void add(float value)
+      {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits) );
+        add(static_cast<std::uint64_t>(bits) );
+      }
+      void add(const std::string& value)
+      {
+        add(static_cast<std::uint64_t>(value.size() ) );
+        for (char c : value)
+          add(static_cast<unsigned char>(c) );
+      }
+      void add(const RDFAnalysis::SchedulerBase::Action& action)
+      {
+        add(static_cast<std::uint64_t>(action.type) );
+        add(action.name);
+      }
+      std::uint64_t value() const { return m_value; }
+    private:
+      std::uint64_t m_value{14695981039346656037ull};
+  }; //> end class StableHash
+
+  /// The first line of a schedule file
+  const std::string scheduleFileHeader = "RDFAnalysisSchedule 1";
+
+  /// The first line of a cost file
+  const std::string costFileHeader = "RDFAnalysisCosts 2";
+
+  /// The filters applied by a set of regions, merged where the regions share
+  /// a prefix
+  struct FilterTrie {
+    std::map<std::string, FilterTrie> children;
+  }; //> end struct FilterTrie
+
+  /// Count the filter evaluations below a node of the trie, per entry reaching
+  /// that node
+  double countEvaluations(
+      const FilterTrie& node,
+      const std::map<std::string, float>& passFractions)
+  {
+    double count = 0;
+    for (const auto& childPair : node.children) {
+      auto itr = passFractions.find(childPair.first);
+      double pass = itr == passFractions.end() ? 1 : itr->second;
+      count += 1 + pass * countEvaluations(childPair.second, passFractions);
+    }
+    return count;
+  }
+
+  /// The estimated evaluations and cost of a set of filters
+  using FilterScore = std::pair<double, double>;
+
+  /**
+   * Search for the filter order in each region that minimises the estimated
+   * number of filter evaluations.
+   *
+   * At each point of the tree a filter is chosen and every region that can
+   * apply it next does so, while the others are handled at the same point.
+   * Small problems are searched exhaustively, memoising on the filters left in
+   * each region. If the number of states grows too large the search falls back
+   * to taking the filter that the most regions can share, preferring the
+   * tighter and then the cheaper filter.
+   */
+  class FilterOrderSearch {
+    public:
+      using bitset_t = boost::dynamic_bitset<>;
+
+      FilterOrderSearch(
+          std::vector<double> passFractions,
+          std::vector<double> costs,
+          std::vector<bitset_t> prerequisites) :
+        m_passFractions(std::move(passFractions) ),
+        m_costs(std::move(costs) ),
+        m_prerequisites(std::move(prerequisites) ) {}
+
+      /// Find the order of the filters in each region
+      std::vector<std::vector<std::size_t>> solve(
+          const std::vector<bitset_t>& regions)
+      {
+        std::vector<Member> group;
+        for (std::size_t idx = 0; idx < regions.size(); ++idx)
+          if (regions.at(idx).any() )
+            group.push_back({regions.at(idx), idx});
+        m_exact = true;
+        try {
+          exact(group);
+        }
+        catch (const SearchTooLarge&) {
+          m_exact = false;
+          m_memo.clear();
+        }
+        std::vector<std::vector<std::size_t>> orders(regions.size() );
+        assign(group, orders);
+        return orders;
+      }
+
+    private:
+      /// A region and the filters it still has to apply
+      struct Member {
+        bitset_t remaining;
+        std::size_t region;
+      };
+
+      /// Thrown when the exhaustive search has too many states
+      struct SearchTooLarge {};
+
+      /// The maximum number of states for the exhaustive search
+      static constexpr std::size_t maxStates = 10000;
+
+      /// Whether a region can apply a filter next
+      bool available(const bitset_t& remaining, std::size_t filter) const
+      {
+        return remaining.test(filter) &&
+          !remaining.intersects(m_prerequisites.at(filter) );
+      }
+
+      /// The filters that can be applied next by any member of a group
+      bitset_t candidates(const std::vector<Member>& group) const
+      {
+        bitset_t result(m_costs.size() );
+        for (const Member& member : group)
+          for (std::size_t filter = member.remaining.find_first();
+              filter != bitset_t::npos;
+              filter = member.remaining.find_next(filter) )
+            if (available(member.remaining, filter) )
+              result.set(filter);
+        return result;
+      }
+
+      /// Split a group into the members that apply a filter next (with that
+      /// filter removed) and the rest. Members with no filters left are
+      /// dropped.
+      void split(
+          const std::vector<Member>& group,
+          std::size_t filter,
+          std::vector<Member>& child,
+          std::vector<Member>& rest) const
+      {
+        for (const Member& member : group) {
+          if (available(member.remaining, filter) ) {
+            Member next = member;
+            next.remaining.reset(filter);
+            if (next.remaining.any() )
+              child.push_back(std::move(next) );
+          }
+          else
+            rest.push_back(member);
+        }
+      }
+
+      /// The memoisation key of a group
+      std::vector<bitset_t> key(const std::vector<Member>& group) const
+      {
+        std::vector<bitset_t> result;
+        result.reserve(group.size() );
+        for (const Member& member : group)
+          result.push_back(member.remaining);
+        std::sort(result.begin(), result.end() );
+        return result;
+      }
+
+      /// Find the best score for a group, recording the best first filter
+      FilterScore exact(const std::vector<Member>& group)
+      {
+        if (group.empty() )
+          return {0, 0};
+        std::vector<bitset_t> groupKey = key(group);
+        auto itr = m_memo.find(groupKey);
+        if (itr != m_memo.end() )
+          return itr->second.first;
+        if (m_memo.size() >= maxStates)
+          throw SearchTooLarge();
+        FilterScore best(
+            std::numeric_limits<double>::infinity(),
+            std::numeric_limits<double>::infinity() );
+        std::size_t choice = bitset_t::npos;
+        bitset_t options = candidates(group);
+        for (std::size_t filter = options.find_first();
+            filter != bitset_t::npos;
+            filter = options.find_next(filter) ) {
+          std::vector<Member> child;
+          std::vector<Member> rest;
+          split(group, filter, child, rest);
+          FilterScore childScore = exact(child);
+          FilterScore restScore = exact(rest);
+          double pass = m_passFractions.at(filter);
+          FilterScore score(
+              1 + pass * childScore.first + restScore.first,
+              m_costs.at(filter) + pass * childScore.second + restScore.second);
+          if (score < best) {
+            best = score;
+            choice = filter;
+          }
+        }
+        m_memo[groupKey] = std::make_pair(best, choice);
+        return best;
+      }
+
+      /// Choose the next filter for a group
+      std::size_t choose(const std::vector<Member>& group) const
+      {
+        if (m_exact)
+          return m_memo.at(key(group) ).second;
+        std::size_t choice = bitset_t::npos;
+        std::size_t bestShared = 0;
+        bitset_t options = candidates(group);
+        for (std::size_t filter = options.find_first();
+            filter != bitset_t::npos;
+            filter = options.find_next(filter) ) {
+          std::size_t shared = std::count_if(group.begin(), group.end(),
+              [this, filter] (const Member& member)
+              { return available(member.remaining, filter); });
+          if (choice == bitset_t::npos ||
+              std::make_tuple(shared, -m_passFractions.at(filter), -m_costs.at(filter) ) >
+              std::make_tuple(bestShared, -m_passFractions.at(choice), -m_costs.at(choice) ) ) {
+            choice = filter;
+            bestShared = shared;
+          }
+        }
+        return choice;
+      }
+
+      /// Fill the orders for a group
+      void assign(
+          const std::vector<Member>& group,
+          std::vector<std::vector<std::size_t>>& orders) const
+      {
+        if (group.empty() )
+          return;
+        std::size_t filter = choose(group);
+        if (filter == bitset_t::npos)
+          throw std::runtime_error(
+              "Unable to order region filters, are there circular dependencies?");
+        for (const Member& member : group)
+          if (available(member.remaining, filter) )
+            orders.at(member.region).push_back(filter);
+        std::vector<Member> child;
+        std::vector<Member> rest;
+        split(group, filter, child, rest);
+        assign(child, orders);
+        assign(rest, orders);
+      }
+
+      std::vector<double> m_passFractions;
+      std::vector<double> m_costs;
+      std::vector<bitset_t> m_prerequisites;
+      bool m_exact{true};
+      std::map<std::vector<bitset_t>, std::pair<FilterScore, std::size_t>> m_memo;
+  }; //> end class FilterOrderSearch
+
+  /// Remove any parentheses that enclose the whole of an expression
+  std::string stripParentheses(std::string expression)
+  {
+    while (expression.size() > 1 &&
+        expression.front() == '(' && expression.back() == ')') {
+      // Make sure that the opening bracket is closed by the last one
+      int depth = 0;
+      std::size_t idx = 0;
+      for (; idx < expression.size(); ++idx) {
+        if (expression[idx] == '(')
+          ++depth;
+        else if (expression[idx] == ')' && --depth == 0)
+          break;
+      }
+      if (idx != expression.size() - 1)
+        break;
+      expression = expression.substr(1, expression.size() - 2);
+    }
+    return expression;
+  }
+
+  /// Split an expression (without whitespace) into the terms of a conjunction,
+  /// returning false if it cannot be read
+  bool splitConjunction(
+      const std::string& expression,
+      std::vector<std::string>& terms)
+  {
+    std::string stripped = stripParentheses(expression);
+    int depth = 0;
+    std::size_t start = 0;
+    bool split = false;
+    for (std::size_t idx = 0; idx < stripped.size(); ++idx) {
+      char c = stripped[idx];
+      if (c == '(')
+        ++depth;
+      else if (c == ')')
+        --depth;
+      else if (c == '|' && depth == 0)
+        return false;
+      else if (depth == 0 && stripped.compare(idx, 2, "&&") == 0) {
+        if (!splitConjunction(stripped.substr(start, idx - start), terms) )
+          return false;
+        start = idx + 2;
+        ++idx;
+        split = true;
+      }
+    }
+    if (split)
+      return splitConjunction(stripped.substr(start), terms);
+    terms.push_back(stripped);
+    return true;
+  }
+
+  /// Write a string, prefixed by its length
+  void writeString(std::ostream& os, const std::string& value)
+  {
+    os << value.size() << ' ' << value;
+  }
+
+  /// Read a string written by writeString
+  bool readString(std::istream& is, std::string& value)
+  {
+    std::size_t size;
+    if (!(is >> size) || is.get() != ' ')
+      return false;
+    value.resize(size);
+    return size == 0 || is.read(&value[0], size);
+  }
 } //> end anonymous namespace
 
 namespace RDFAnalysis {
@@ -102,53 +460,186 @@ namespace RDFAnalysis {
     return region;
   }
 
+  SystematicMask SchedulerBase::RegionDef::systematicsMask(
+      const SystematicRegistry& registry) const
+  {
+    SystematicMask mask;
+    if (restrictSystematics) {
+      for (const std::string& name : allowedSystematics) {
+        SysID_t syst = registry.find(name);
+        if (syst != SystematicRegistry::npos)
+          mask.set(syst);
+      }
+    }
+    else
+      mask.set();
+    for (const std::string& name : deniedSystematics) {
+      SysID_t syst = registry.find(name);
+      if (syst != SystematicRegistry::npos)
+        mask.reset(syst);
+    }
+    mask.set(SystematicRegistry::nominalID);
+    return mask;
+  }
+
+  constexpr SchedulerBase::ActionID_t SchedulerBase::noAction;
+
   void SchedulerBase::filterSatisfies(
       const std::string& filter,
       const std::vector<std::string>& satisfied)
   {
     for (const std::string& f : satisfied)
       m_satisfiedBy[Action(FILTER, f)].insert({FILTER, filter});
+    m_actionTableValid = false;
+  }
+
+  void SchedulerBase::inferFilterSatisfaction(
+      const std::string& filter,
+      const std::string& expression,
+      const std::vector<std::string>& columns,
+      bool weighted)
+  {
+    std::string compact;
+    std::remove_copy_if(expression.begin(), expression.end(),
+        std::back_inserter(compact),
+        [] (char c) { return std::isspace(static_cast<unsigned char>(c) ); });
+    std::vector<std::string> terms;
+    if (!splitConjunction(compact, terms) )
+      return;
+    static const std::string number =
+      "([-+]?(?:\\d+\\.?\\d*|\\.\\d+)(?:[eE][-+]?\\d+)?)[fFuUlL]*";
+    static const std::regex columnFirst(
+        "\\{(\\d+)\\}(<=|>=|==|<|>)" + number);
+    static const std::regex numberFirst(
+        number + "(<=|>=|==|<|>)\\{(\\d+)\\}");
+    const double inf = std::numeric_limits<double>::infinity();
+    ThresholdFilter threshold{{}, weighted};
+    for (const std::string& term : terms) {
+      std::smatch sm;
+      std::size_t index;
+      std::string op;
+      double value;
+      if (std::regex_match(term, sm, columnFirst) ) {
+        index = std::stoul(sm.str(1) );
+        op = sm.str(2);
+        value = std::stod(sm.str(3) );
+      }
+      else if (std::regex_match(term, sm, numberFirst) ) {
+        // Write the comparison with the column first
+        value = std::stod(sm.str(1) );
+        op = sm.str(2);
+        index = std::stoul(sm.str(3) );
+        if (op[0] == '<')
+          op[0] = '>';
+        else if (op[0] == '>')
+          op[0] = '<';
+      }
+      else
+        return;
+      if (index >= columns.size() )
+        return;
+      auto cutItr = threshold.cuts.insert(std::make_pair(
+            columns.at(index), ThresholdCut{-inf, false, inf, false}) ).first;
+      ThresholdCut& cut = cutItr->second;
+      bool inclusive = op.size() == 2;
+      if (op[0] == '>' || op == "==") {
+        if (value > cut.lower || (value == cut.lower && !inclusive) ) {
+          cut.lower = value;
+          cut.lowerInclusive = inclusive;
+        }
+      }
+      if (op[0] == '<' || op == "==") {
+        if (value < cut.upper || (value == cut.upper && !inclusive) ) {
+          cut.upper = value;
+          cut.upperInclusive = inclusive;
+        }
+      }
+    }
+    // Only record relations where one filter is strictly tighter, otherwise
+    // the two would satisfy each other
+    for (const auto& otherPair : m_thresholdFilters) {
+      const ThresholdFilter& other = otherPair.second;
+      bool impliesOther = threshold.implies(other);
+      bool impliedByOther = other.implies(threshold);
+      if (impliesOther && !impliedByOther && !other.weighted)
+        filterSatisfies(filter, {otherPair.first});
+      else if (impliedByOther && !impliesOther && !weighted)
+        filterSatisfies(otherPair.first, {filter});
+    }
+    m_thresholdFilters[filter] = std::move(threshold);
   }
-  
-  std::map<SchedulerBase::Action, std::set<SchedulerBase::Action>, SchedulerBase::Action::CostOrdering> SchedulerBase::Action::expand(
-      const SchedulerBase& scheduler,
-      const std::set<Action>& preExisting,
-      std::vector<Action>& processing) const 
+
+  bool SchedulerBase::ThresholdCut::within(const ThresholdCut& other) const
   {
-    if (std::count(processing.begin(), processing.end(), *this) )
+    bool lowerWithin = lower > other.lower ||
+      (lower == other.lower && (!lowerInclusive || other.lowerInclusive) );
+    bool upperWithin = upper < other.upper ||
+      (upper == other.upper && (!upperInclusive || other.upperInclusive) );
+    return lowerWithin && upperWithin;
+  }
+
+  bool SchedulerBase::ThresholdFilter::implies(
+      const ThresholdFilter& other) const
+  {
+    for (const auto& cutPair : other.cuts) {
+      auto itr = cuts.find(cutPair.first);
+      if (itr == cuts.end() || !itr->second.within(cutPair.second) )
+        return false;
+    }
+    return true;
+  }
+
+  void SchedulerBase::Action::retrieveCost(const SchedulerBase& scheduler) {
+    cost = scheduler.getCost(*this);
+  }
+
+  const SchedulerBase::DependencyList& SchedulerBase::expand(
+      ActionID_t action,
+      ExpansionCache& cache,
+      std::vector<ActionID_t>& processing) const
+  {
+    // If this has already been expanded against the same pre-existing actions
+    // then reuse that
+    auto cacheItr = cache.expanded.find(action);
+    if (cacheItr != cache.expanded.end() )
+      return cacheItr->second;
+    const Action& unresolved = m_actionTable.at(action);
+    if (std::count(processing.begin(), processing.end(), action) )
       throw std::runtime_error(
-          "Circular dependency found on " + name + "!");
-
-    // Create a copy of this and make sure that we have the correct cost from
-    // the scheduler
-    Action thisCopy(*this);
-    if (type == VARIABLE) {
-      std::set<Action> loopTracker;
-      while (!scheduler.m_dependencies.count(thisCopy) ) {
-        if (!loopTracker.insert(thisCopy).second)
+          "Circular dependency found on " + unresolved.name + "!");
+
+    // Find the action that actually defines this one
+    ActionID_t resolved = action;
+    if (unresolved.type == VARIABLE) {
+      std::set<ActionID_t> loopTracker;
+      while (!m_definedActions.test(resolved) ) {
+        if (!loopTracker.insert(resolved).second)
           throw std::runtime_error(
               "Closed loop found in satisfaction relations!");
         // Actions that can be satisfied by other actions may have no entry in
         // the dependencies map. In this case, look for them in the 'satisfied
-        // by' map
-        auto itr = scheduler.m_satisfiedBy.find(thisCopy);
-        if (itr == scheduler.m_satisfiedBy.end() || itr->second.size() == 0)
+        // by' relations. Just use the first one
+        resolved = m_satisfactionMatrix.at(resolved).find_first();
+        if (resolved == boost::dynamic_bitset<>::npos)
           throw std::runtime_error(
               "No action of type '" +
-              actionTypeToString(type) +
-              "' and name '" + name + "' defined!");
-        // Just use the first one
-        thisCopy = *itr->second.begin();
-      }
-    }
-    thisCopy.retrieveCost(scheduler);
-    // Prepare the output
-    std::map<Action, std::set<Action>, CostOrdering> output;
-    // Make sure that there is an entry for this, even if it doesn't have any
-    // dependencies
-    std::set<Action>& thisDependencies = output[thisCopy];
+              actionTypeToString(unresolved.type) +
+              "' and name '" + unresolved.name + "' defined!");
+      }
+    }
+    else if (!m_definedActions.test(resolved) )
+      throw std::out_of_range(
+          "No action of type '" +
+          actionTypeToString(unresolved.type) +
+          "' and name '" + unresolved.name + "' defined!");
+    const boost::dynamic_bitset<>& preExisting = cache.preExisting;
+    // The direct dependencies of this action
+    std::vector<ActionID_t> thisDependencies;
+    // Everything picked up from expanding those dependencies. If the same
+    // action appears more than once the first entry is used.
+    DependencyList collected;
     // Add this to the processing list
-    processing.push_back(thisCopy);
+    processing.push_back(resolved);
     // We need to keep track of the filters that we define. Specifically we need
     // to remove any redundancies (i.e. including two filters where one is
     // strictly looser than an other).
@@ -160,90 +651,95 @@ namespace RDFAnalysis {
     // with n_B >= 2
     // For this, we need to look through all filters that are dependencies
     // To save time, build this list up now
-    std::set<Action> filters;
-    // Read the dependencies from the scheduler
-    for (const Action& dep : scheduler.getDependencies(thisCopy) ) {
+    boost::dynamic_bitset<> filters(m_actionTable.size() );
+    for (std::size_t depIdx = m_dependencyOffsets.at(resolved);
+        depIdx != m_dependencyOffsets.at(resolved+1);
+        ++depIdx) {
+      ActionID_t dep = m_dependencyIDs.at(depIdx);
       // Skip any dependency that is already satisfied
-      if (scheduler.isActionSatisfiedBy(dep, preExisting) )
+      if (firstSatisfiedBy(dep, preExisting) != noAction)
         continue;
-      if (dep.type == FILTER)
-        filters.insert(dep);
+      if (m_actionTable.at(dep).type == FILTER)
+        filters.set(dep);
       // Add this to our dependencies
-      thisDependencies.insert(dep);
-      // Expand this dependency
-      std::map<Action, std::set<Action>, CostOrdering> expanded = dep.expand(
-          scheduler, preExisting, processing);
-      // Add these to the output
-      output.insert(expanded.begin(), expanded.end() );
-      for (const auto& p : expanded)
-        if (p.first.type == FILTER)
-          filters.insert(p.first);
-    }
-    std::map<Action, Action> replacementMap = scheduler.buildReplacementMap(filters);
+      thisDependencies.push_back(dep);
+      // Expand this dependency and add it to the output
+      for (const DependencyEntry& entry : expand(dep, cache, processing) ) {
+        collected.push_back(entry);
+        if (m_actionTable.at(entry.action).type == FILTER)
+          filters.set(entry.action);
+      }
+    }
+    // Form the output. This action always comes first so that its entry takes
+    // precedence
+    DependencyList output;
+    output.reserve(collected.size() + 1);
+    output.push_back({resolved, std::move(thisDependencies)});
+    std::move(collected.begin(), collected.end(), std::back_inserter(output) );
+    std::stable_sort(output.begin(), output.end(),
+        [this] (const DependencyEntry& lhs, const DependencyEntry& rhs)
+        { return m_costRanks[lhs.action] < m_costRanks[rhs.action]; });
+    output.erase(
+        std::unique(output.begin(), output.end(),
+          [] (const DependencyEntry& lhs, const DependencyEntry& rhs)
+          { return lhs.action == rhs.action; }),
+        output.end() );
     // Replace all indirect dependencies of anything using this map
-    for (const auto& repPair : replacementMap) {
+    for (const auto& repPair : buildReplacementMap(filters) ) {
       auto outItr = output.begin();
       while (outItr != output.end() ) {
-        if (outItr->first == repPair.first)
+        if (outItr->action == repPair.first)
           // Remove direct dependency
           outItr = output.erase(outItr);
         else {
-          if (outItr->second.erase(repPair.first) )
+          std::vector<ActionID_t>& deps = outItr->dependencies;
+          auto depItr = std::lower_bound(deps.begin(), deps.end(), repPair.first);
+          if (depItr != deps.end() && *depItr == repPair.first) {
             // Replace indirect dependency
-            outItr->second.insert(repPair.second);
+            deps.erase(depItr);
+            depItr = std::lower_bound(deps.begin(), deps.end(), repPair.second);
+            if (depItr == deps.end() || *depItr != repPair.second)
+              deps.insert(depItr, repPair.second);
+          }
           ++outItr;
         }
       }
     }
     processing.pop_back();
-    return output;
+    return cache.expanded.emplace(action, std::move(output) ).first->second;
   }
 
-  std::map<SchedulerBase::Action, std::set<SchedulerBase::Action>, SchedulerBase::Action::CostOrdering> SchedulerBase::Action::expand(
-      const SchedulerBase& scheduler,
-      const std::set<Action>& preExisting) const
-  {
-    std::vector<Action> processing;
-    return expand(scheduler, preExisting, processing);
-  }
-
-  void SchedulerBase::Action::retrieveCost(const SchedulerBase& scheduler) {
-    cost = scheduler.getCost(*this);
-  }
-
-  const SchedulerBase::Action& SchedulerBase::ScheduleNode::next() const
+  SchedulerBase::ActionID_t SchedulerBase::PendingNode::next(
+      const SchedulerBase& scheduler) const
   {
     auto itr = dependencies.begin();
     for (; itr != dependencies.end(); ++itr)
-      if (itr->second.empty() )
+      if (itr->dependencies.empty() )
         break;
     if (itr == dependencies.end() ) {
       throw std::out_of_range(
-          "No next action left on " + action.name);
+          "No next action left on " + scheduler.m_actionTable.at(action).name);
     }
-    return itr->first;
+    return itr->action;
   }
 
-  void SchedulerBase::ScheduleNode::removeDependency(
-      Action action, const SchedulerBase& scheduler)
+  void SchedulerBase::PendingNode::removeDependency(
+      ActionID_t action, const SchedulerBase& scheduler)
   {
     auto directItr = dependencies.begin();
     while (directItr != dependencies.end() ) {
-      if (scheduler.isActionSatisfiedBy(directItr->first, {action}) ) {
+      if (scheduler.isSatisfiedBy(directItr->action, action) ) {
         // remove the action as a direct dependency
         directItr = dependencies.erase(directItr);
       }
       else {
-        auto indirectItr = directItr->second.begin();
-        while (indirectItr != directItr->second.end() ) {
-          if (scheduler.isActionSatisfiedBy(*indirectItr, {action}) ) {
-            // remove the action as an indirect dependency
-            indirectItr = directItr->second.erase(indirectItr);
-          }
-          else {
-            ++indirectItr;
-          }
-        }
+        // remove the action as an indirect dependency
+        std::vector<ActionID_t>& indirect = directItr->dependencies;
+        indirect.erase(
+            std::remove_if(indirect.begin(), indirect.end(),
+              [&scheduler, action] (ActionID_t dep)
+              { return scheduler.isSatisfiedBy(dep, action); }),
+            indirect.end() );
         ++directItr;
       }
     }
@@ -266,6 +762,7 @@ namespace RDFAnalysis {
     if (!m_dependencies.insert(std::make_pair(action, dependencies) ).second)
       throw std::runtime_error(actionTypeToString(action.type) +
           " name '" + action.name + "' is already defined!");
+    m_actionTableValid = false;
   }
 
   const std::set<SchedulerBase::Action>& SchedulerBase::getDependencies(
@@ -292,6 +789,232 @@ namespace RDFAnalysis {
     return itr->first.cost;
   }
 
+  void SchedulerBase::setCost(const Action& action, float cost)
+  {
+    auto itr = m_dependencies.find(action);
+    if (itr == m_dependencies.end() )
+      throw std::out_of_range(
+          "No action of type '" +
+          actionTypeToString(action.type) +
+          "' and name '" + action.name + "' defined!");
+    // The cost isn't part of the ordering but the key is const so the entry
+    // has to be replaced
+    std::set<Action> dependencies = std::move(itr->second);
+    m_dependencies.erase(itr);
+    m_dependencies.insert(std::make_pair(
+          Action(action.type, action.name, cost), std::move(dependencies) ) );
+    m_actionTableValid = false;
+  }
+
+  void SchedulerBase::writeCosts(const std::string& fileName) const
+  {
+    // If the file cannot be moved into place another job has just written
+    // the same costs, so there is nothing left to do
+    writeFileAtomically(fileName, [this] (std::ostream& os) {
+        os << costFileHeader << '\n'
+           << std::hex << actionsHash() << std::dec << '\n'
+           << std::setprecision(9) << m_dependencies.size() << '\n';
+        for (const auto& depPair : m_dependencies) {
+          os << static_cast<int>(depPair.first.type) << ' '
+             << depPair.first.cost << ' '
+             << (depPair.first.type == FILTER ?
+                 passFraction(depPair.first.name) : 1) << ' ';
+          writeString(os, depPair.first.name);
+          os << '\n';
+        }
+      });
+  }
+
+  bool SchedulerBase::readCosts(const std::string& fileName)
+  {
+    std::ifstream is(fileName);
+    if (!is)
+      return false;
+    std::string header;
+    std::getline(is, header);
+    std::uint64_t fileHash;
+    std::size_t nActions;
+    if (header != costFileHeader ||
+        !(is >> std::hex >> fileHash >> std::dec) ||
+        fileHash != actionsHash() ||
+        !(is >> nActions) ||
+        nActions != m_dependencies.size() )
+      return false;
+    std::vector<std::pair<Action, float>> actions;
+    actions.reserve(nActions);
+    for (std::size_t idx = 0; idx < nActions; ++idx) {
+      int type;
+      float cost;
+      float pass;
+      std::string name;
+      if (!(is >> type >> cost >> pass) || is.get() != ' ' ||
+          !readString(is, name) ||
+          type < FILTER || type >= INVALID ||
+          pass < 0 || pass > 1)
+        return false;
+      actions.emplace_back(
+          Action(static_cast<ActionType>(type), name, cost), pass);
+    }
+    for (const auto& actionPair : actions) {
+      setCost(actionPair.first, actionPair.first.cost);
+      if (actionPair.first.type == FILTER)
+        setPassFraction(actionPair.first.name, actionPair.second);
+    }
+    return true;
+  }
+
+  void SchedulerBase::setPassFraction(
+      const std::string& filter,
+      float fraction)
+  {
+    if (fraction < 0 || fraction > 1)
+      throw std::out_of_range(
+          "Invalid pass fraction " + std::to_string(fraction) +
+          " for filter '" + filter + "'!");
+    m_passFractions[filter] = fraction;
+  }
+
+  float SchedulerBase::passFraction(const std::string& filter) const
+  {
+    auto itr = m_passFractions.find(filter);
+    return itr == m_passFractions.end() ? 1 : itr->second;
+  }
+
+  double SchedulerBase::estimatedFilterEvaluations(
+      const std::map<std::string, RegionDef>& regionDefs) const
+  {
+    FilterTrie root;
+    for (const auto& regionPair : regionDefs) {
+      FilterTrie* current = &root;
+      for (const std::string& filter : regionPair.second.filterList)
+        current = &current->children[filter];
+    }
+    return countEvaluations(root, m_passFractions);
+  }
+
+  std::map<std::string, SchedulerBase::RegionDef> SchedulerBase::optimizedRegionDefs(
+      const std::map<std::string, RegionDef>& regionDefs) const
+  {
+    std::map<std::string, RegionDef> optimized = regionDefs;
+    // Regions that have the same filters as another region (or that repeat a
+    // filter) would become indistinguishable, so leave them alone
+    std::map<std::set<std::string>, std::size_t> filterSets;
+    for (const auto& regionPair : regionDefs)
+      ++filterSets[{
+        regionPair.second.filterList.begin(),
+        regionPair.second.filterList.end()}];
+    std::vector<std::string> regionNames;
+    std::vector<std::string> filters;
+    std::map<std::string, std::size_t> filterIndices;
+    for (const auto& regionPair : regionDefs) {
+      const std::vector<std::string>& filterList = regionPair.second.filterList;
+      std::set<std::string> filterSet(filterList.begin(), filterList.end() );
+      if (filterSet.size() != filterList.size() ||
+          filterSets.at(filterSet) > 1)
+        continue;
+      regionNames.push_back(regionPair.first);
+      for (const std::string& filter : filterList)
+        if (filterIndices.insert(std::make_pair(filter, filters.size() ) ).second)
+          filters.push_back(filter);
+    }
+
+    // Collect the properties of each filter
+    std::size_t nFilters = filters.size();
+    std::vector<double> passFractions;
+    std::vector<double> costs;
+    std::vector<boost::dynamic_bitset<>> prerequisites;
+    passFractions.reserve(nFilters);
+    costs.reserve(nFilters);
+    prerequisites.reserve(nFilters);
+    for (const std::string& filter : filters) {
+      passFractions.push_back(passFraction(filter) );
+      auto itr = m_dependencies.find({FILTER, filter});
+      costs.push_back(itr == m_dependencies.end() ? 0 : itr->first.cost);
+      std::set<std::string> dependencies;
+      std::set<Action> visited;
+      collectFilterDependencies({FILTER, filter}, dependencies, visited);
+      prerequisites.emplace_back(nFilters);
+      for (const std::string& dependency : dependencies) {
+        auto indexItr = filterIndices.find(dependency);
+        if (indexItr != filterIndices.end() && dependency != filter)
+          prerequisites.back().set(indexItr->second);
+      }
+    }
+
+    std::vector<boost::dynamic_bitset<>> regions;
+    regions.reserve(regionNames.size() );
+    for (const std::string& name : regionNames) {
+      regions.emplace_back(nFilters);
+      for (const std::string& filter : regionDefs.at(name).filterList)
+        regions.back().set(filterIndices.at(filter) );
+    }
+    FilterOrderSearch search(
+        std::move(passFractions), std::move(costs), std::move(prerequisites) );
+    std::vector<std::vector<std::size_t>> orders = search.solve(regions);
+    for (std::size_t idx = 0; idx < regionNames.size(); ++idx) {
+      std::vector<std::string>& filterList =
+        optimized.at(regionNames.at(idx) ).filterList;
+      filterList.clear();
+      for (std::size_t filter : orders.at(idx) )
+        filterList.push_back(filters.at(filter) );
+    }
+    // The greedy search is not guaranteed to improve on the original order
+    if (estimatedFilterEvaluations(optimized) >
+        estimatedFilterEvaluations(regionDefs) )
+      return regionDefs;
+    return optimized;
+  }
+
+  void SchedulerBase::collectFilterDependencies(
+      const Action& action,
+      std::set<std::string>& filters,
+      std::set<Action>& visited) const
+  {
+    if (!visited.insert(action).second)
+      return;
+    auto itr = m_dependencies.find(action);
+    if (itr == m_dependencies.end() ) {
+      // This could be a variable defined by an action that defines several
+      auto satItr = m_satisfiedBy.find(action);
+      if (action.type == VARIABLE && satItr != m_satisfiedBy.end() )
+        for (const Action& satisfier : satItr->second)
+          collectFilterDependencies(satisfier, filters, visited);
+      return;
+    }
+    for (const Action& dependency : itr->second) {
+      if (dependency.type == FILTER)
+        filters.insert(dependency.name);
+      collectFilterDependencies(dependency, filters, visited);
+    }
+  }
+
+  SchedulerBase::ExpansionCache& SchedulerBase::expansionCache(
+      ExpansionCacheStore& store,
+      const boost::dynamic_bitset<>& preExisting)
+  {
+    std::size_t hash = hashActions(preExisting);
+    auto range = store.equal_range(hash);
+    for (auto itr = range.first; itr != range.second; ++itr)
+      if (itr->second.preExisting == preExisting)
+        return itr->second;
+    return store.emplace(hash, ExpansionCache(preExisting) )->second;
+  }
+
+  void SchedulerBase::SchedulingState::useVariable(ActionID_t id)
+  {
+    usedVars.set(id);
+    newVars.push_back(id);
+  }
+
+  bool SchedulerBase::SchedulingState::acquireWorker()
+  {
+    std::size_t nFree = freeWorkers->load();
+    while (nFree > 0)
+      if (freeWorkers->compare_exchange_weak(nFree, nFree - 1) )
+        return true;
+    return false;
+  }
+
   bool SchedulerBase::isActionSatisfiedBy(
       const Action& action,
       const std::set<Action>& candidates,
@@ -312,37 +1035,180 @@ namespace RDFAnalysis {
       satisfiedBy = action;
       return true;
     }
-    auto itr = m_satisfiedBy.find(action);
-    if (itr == m_satisfiedBy.end() )
+    ActionID_t id = findAction(action);
+    if (id == noAction || m_satisfactionMatrix.at(id).empty() )
       // This action isn't satisfied by anything else.
       return false;
-    std::vector<Action> isSatisfiedBy;
-    std::set_intersection(
-        candidates.begin(), candidates.end(),
-        itr->second.begin(), itr->second.end(),
-        std::back_inserter(isSatisfiedBy) );
-    if (isSatisfiedBy.size() > 0) {
-      satisfiedBy = *isSatisfiedBy.begin();
-      return true;
+    // The candidates are ordered in the same way as the IDs so the first match
+    // is the smallest satisfying action.
+    for (const Action& candidate : candidates) {
+      ActionID_t candidateID = findAction(candidate);
+      if (candidateID != noAction && isSatisfiedBy(id, candidateID, false) ) {
+        satisfiedBy = candidate;
+        return true;
+      }
     }
-    else
-      return false;
+    return false;
   }
 
-  std::map<SchedulerBase::Action, SchedulerBase::Action> SchedulerBase::buildReplacementMap(
-      const std::set<Action>& filters) const
+  bool SchedulerBase::isActionSatisfiedBy(
+      const Action& action,
+      const Action& candidate,
+      bool considerSelf) const
   {
-    std::map<Action, Action> replacementMap;
-    for (const Action& action : filters) {
-      Action satisfiedBy = action;
-      if (isActionSatisfiedBy(action, filters, satisfiedBy, false) ) {
-        replacementMap.insert(std::make_pair(action, satisfiedBy) );
-        for (auto& repPair : replacementMap)
-          // We also need to update everything that was originally replacing
-          // *to* action
-          if (repPair.second == action)
-            repPair.second = satisfiedBy;
+    if (action == candidate)
+      return considerSelf;
+    ActionID_t id = findAction(action);
+    ActionID_t candidateID = findAction(candidate);
+    return id != noAction && candidateID != noAction &&
+      isSatisfiedBy(id, candidateID, considerSelf);
+  }
+
+  bool SchedulerBase::isSatisfiedBy(
+      ActionID_t action,
+      ActionID_t candidate,
+      bool considerSelf) const
+  {
+    if (action == candidate && considerSelf)
+      return true;
+    const boost::dynamic_bitset<>& row = m_satisfactionMatrix.at(action);
+    return !row.empty() && row.test(candidate);
+  }
+
+  SchedulerBase::ActionID_t SchedulerBase::firstSatisfiedBy(
+      ActionID_t action,
+      const boost::dynamic_bitset<>& candidates,
+      bool considerSelf) const
+  {
+    if (considerSelf && candidates.test(action) )
+      return action;
+    const boost::dynamic_bitset<>& row = m_satisfactionMatrix.at(action);
+    if (row.empty() || !row.intersects(candidates) )
+      return noAction;
+    for (std::size_t idx = row.find_first();
+        idx != boost::dynamic_bitset<>::npos;
+        idx = row.find_next(idx) )
+      if (candidates.test(idx) )
+        return idx;
+    return noAction;
+  }
+
+  SchedulerBase::ActionID_t SchedulerBase::findAction(
+      const Action& action) const
+  {
+    if (!m_actionTableValid)
+      buildActionTable();
+    auto itr = m_actionIDs.find(action);
+    return itr == m_actionIDs.end() ? noAction : itr->second;
+  }
+
+  void SchedulerBase::buildActionTable() const
+  {
+    // Collect every action that the scheduler knows about. Inserting the
+    // defined actions first ensures that we keep their costs.
+    std::set<Action> actions;
+    for (const auto& depPair : m_dependencies)
+      actions.insert(depPair.first);
+    for (const auto& depPair : m_dependencies)
+      actions.insert(depPair.second.begin(), depPair.second.end() );
+    for (const auto& satPair : m_satisfiedBy) {
+      actions.insert(satPair.first);
+      actions.insert(satPair.second.begin(), satPair.second.end() );
+    }
+    for (const auto& regionPair : m_regionDefs) {
+      for (const std::string& filter : regionPair.second.filterList)
+        actions.insert({FILTER, filter});
+      for (const std::string& fill : regionPair.second.fills)
+        actions.insert({FILL, fill});
+    }
+    // Assign the IDs
+    m_actionTable.assign(actions.begin(), actions.end() );
+    std::size_t nActions = m_actionTable.size();
+    m_actionIDs.clear();
+    for (ActionID_t id = 0; id < nActions; ++id)
+      m_actionIDs.emplace_hint(m_actionIDs.end(), m_actionTable[id], id);
+
+    // Convert the dependencies
+    m_definedActions.clear();
+    m_definedActions.resize(nActions);
+    m_dependencyOffsets.assign(1, 0);
+    m_dependencyOffsets.reserve(nActions + 1);
+    m_dependencyIDs.clear();
+    for (ActionID_t id = 0; id < nActions; ++id) {
+      auto itr = m_dependencies.find(m_actionTable[id]);
+      if (itr != m_dependencies.end() ) {
+        m_definedActions.set(id);
+        for (const Action& dep : itr->second)
+          m_dependencyIDs.push_back(m_actionIDs.at(dep) );
       }
+      m_dependencyOffsets.push_back(m_dependencyIDs.size() );
+    }
+
+    // The cost ordering is by cost, then by ID
+    std::vector<ActionID_t> costOrdered(nActions);
+    std::iota(costOrdered.begin(), costOrdered.end(), 0);
+    std::stable_sort(costOrdered.begin(), costOrdered.end(),
+        [this] (ActionID_t lhs, ActionID_t rhs)
+        { return m_actionTable[lhs].cost < m_actionTable[rhs].cost; });
+    m_costRanks.resize(nActions);
+    for (std::size_t rank = 0; rank < nActions; ++rank)
+      m_costRanks[costOrdered[rank]] = rank;
+
+    // Fill the direct satisfaction relations
+    m_satisfactionMatrix.assign(nActions, boost::dynamic_bitset<>() );
+    for (const auto& satPair : m_satisfiedBy) {
+      if (satPair.second.empty() )
+        continue;
+      boost::dynamic_bitset<>& row =
+        m_satisfactionMatrix[m_actionIDs.at(satPair.first)];
+      row.resize(nActions);
+      for (const Action& action : satPair.second)
+        row.set(m_actionIDs.at(action) );
+    }
+    // Now form the transitive closure for the filters. If A is satisfied by B
+    // then A is satisfied by everything that satisfies B. Keep going until
+    // nothing changes, which only takes more than one pass if the relations
+    // contain a cycle.
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (ActionID_t id = 0; id < nActions; ++id) {
+        boost::dynamic_bitset<>& row = m_satisfactionMatrix[id];
+        if (row.empty() || m_actionTable[id].type != FILTER)
+          continue;
+        boost::dynamic_bitset<> expanded = row;
+        for (std::size_t satIdx = row.find_first();
+            satIdx != boost::dynamic_bitset<>::npos;
+            satIdx = row.find_next(satIdx) )
+          if (!m_satisfactionMatrix[satIdx].empty() )
+            expanded |= m_satisfactionMatrix[satIdx];
+        // An action never satisfies itself
+        expanded.reset(id);
+        if (expanded != row) {
+          row = std::move(expanded);
+          changed = true;
+        }
+      }
+    }
+    m_actionTableValid = true;
+  }
+
+  std::map<SchedulerBase::ActionID_t, SchedulerBase::ActionID_t> SchedulerBase::buildReplacementMap(
+      const boost::dynamic_bitset<>& filters) const
+  {
+    std::map<ActionID_t, ActionID_t> replacementMap;
+    for (std::size_t action = filters.find_first();
+        action != boost::dynamic_bitset<>::npos;
+        action = filters.find_next(action) ) {
+      ActionID_t satisfiedBy = firstSatisfiedBy(action, filters, false);
+      if (satisfiedBy == noAction)
+        continue;
+      replacementMap.insert(std::make_pair(action, satisfiedBy) );
+      for (auto& repPair : replacementMap)
+        // We also need to update everything that was originally replacing
+        // *to* action
+        if (repPair.second == action)
+          repPair.second = satisfiedBy;
     }
     return replacementMap;
   }
@@ -354,33 +1220,415 @@ namespace RDFAnalysis {
     for (const std::string& def : defined) {
       m_satisfiedBy[Action(VARIABLE, def)].insert({VARIABLE, name});
     }
+    m_actionTableValid = false;
   }
 
   SchedulerBase::ScheduleNode& SchedulerBase::schedule(
       const IBranchNamer& namer)
   {
-    // TODO - resolve 'satisfaction relations'. i.e. if A satisfies B and B
-    // satisfies C then A should satisfy C. This is only necessary for filters
-    {
-      std::set<Action> processed;
-      expandSatisfiesRelations(m_satisfiedBy.begin(), processed);
+    std::map<std::string, RegionDef> regionDefs = regionsToSchedule(m_regionDefs);
+    for (const auto& regionPair : regionDefs) {
+      RegionDef& scheduled = m_scheduledRegions[regionPair.first];
+      scheduled.filterList = regionPair.second.filterList;
+      scheduled.fills.insert(
+          regionPair.second.fills.begin(), regionPair.second.fills.end() );
     }
-    // Get the raw schedule
-    ScheduleNode rawRoot = rawSchedule();
-    // What pre-existing dependencies are there (i.e. variables in the input
-    // namer).
-    std::set<Action> preExisting;
+    if (m_scheduleFile.empty() ) {
+      buildSchedule(namer, rawSchedule(regionDefs), m_schedule);
+      return m_schedule;
+    }
+    std::uint64_t hash = configurationHash(namer);
+    auto start = std::chrono::steady_clock::now();
+    double buildTime;
+    if (readSchedule(m_scheduleFile, hash, buildTime) ) {
+      std::chrono::duration<double> readTime =
+        std::chrono::steady_clock::now() - start;
+      std::cout << "Read schedule from " << m_scheduleFile << " in "
+                << readTime.count() << "s, saving "
+                << buildTime - readTime.count() << "s." << std::endl;
+      return m_schedule;
+    }
+    std::size_t firstChild = m_schedule.children.size();
+    std::size_t firstVariable = m_usedVars.size();
+    buildSchedule(namer, rawSchedule(regionDefs), m_schedule);
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    writeSchedule(
+        m_scheduleFile, hash, firstChild, firstVariable, elapsed.count() );
+    return m_schedule;
+  }
+
+  SchedulerBase::ScheduleNode SchedulerBase::buildDetachedSchedule(
+      const IBranchNamer& namer,
+      std::vector<std::string>& usedVariables)
+  {
+    // Swap out the stored variables so that the new schedule starts from
+    // nothing and the stored list is left untouched
+    ScheduleNode root({FILTER, "ROOT"});
+    std::vector<std::string> storedVars;
+    m_usedVars.swap(storedVars);
+    try {
+      buildSchedule(namer, rawSchedule(regionsToSchedule(m_regionDefs) ), root);
+    }
+    catch (...) {
+      m_usedVars.swap(storedVars);
+      throw;
+    }
+    m_usedVars.swap(storedVars);
+    usedVariables = std::move(storedVars);
+    return root;
+  }
+
+  std::uint64_t SchedulerBase::configurationHash(
+      const IBranchNamer& namer) const
+  {
+    StableHash hash;
+    hash.add(scheduleFileHeader);
+    hash.add(static_cast<std::uint64_t>(m_dependencies.size() ) );
+    for (const auto& depPair : m_dependencies) {
+      hash.add(depPair.first);
+      hash.add(depPair.first.cost);
+      hash.add(static_cast<std::uint64_t>(depPair.second.size() ) );
+      for (const Action& dep : depPair.second)
+        hash.add(dep);
+    }
+    hash.add(static_cast<std::uint64_t>(m_satisfiedBy.size() ) );
+    for (const auto& satPair : m_satisfiedBy) {
+      hash.add(satPair.first);
+      hash.add(static_cast<std::uint64_t>(satPair.second.size() ) );
+      for (const Action& action : satPair.second)
+        hash.add(action);
+    }
+    hash.add(static_cast<std::uint64_t>(m_optimizeFilterOrder) );
+    hash.add(static_cast<std::uint64_t>(m_passFractions.size() ) );
+    for (const auto& passPair : m_passFractions) {
+      hash.add(passPair.first);
+      hash.add(passPair.second);
+    }
+    hash.add(static_cast<std::uint64_t>(m_regionDefs.size() ) );
+    for (const auto& regionPair : m_regionDefs) {
+      hash.add(regionPair.first);
+      hash.add(static_cast<std::uint64_t>(
+            regionPair.second.filterList.size() ) );
+      for (const std::string& filter : regionPair.second.filterList)
+        hash.add(filter);
+      hash.add(static_cast<std::uint64_t>(regionPair.second.fills.size() ) );
+      for (const std::string& fill : regionPair.second.fills)
+        hash.add(fill);
+    }
+    // The order of the input branches doesn't matter
+    std::set<std::string> branches;
     for (const std::string& branch : namer.branches() )
-      preExisting.insert({VARIABLE, branch});
+      branches.insert(branch);
+    hash.add(static_cast<std::uint64_t>(branches.size() ) );
+    for (const std::string& branch : branches)
+      hash.add(branch);
+    hash.add(static_cast<std::uint64_t>(m_usedVars.size() ) );
+    for (const std::string& var : m_usedVars)
+      hash.add(var);
+    return hash.value();
+  }
+
+  std::uint64_t SchedulerBase::actionsHash() const
+  {
+    StableHash hash;
+    hash.add(costFileHeader);
+    hash.add(static_cast<std::uint64_t>(m_dependencies.size() ) );
+    for (const auto& depPair : m_dependencies) {
+      hash.add(depPair.first);
+      hash.add(static_cast<std::uint64_t>(depPair.second.size() ) );
+      for (const Action& dep : depPair.second)
+        hash.add(dep);
+    }
+    return hash.value();
+  }
+
+  void SchedulerBase::writeSchedule(
+      const std::string& fileName,
+      std::uint64_t hash,
+      std::size_t firstChild,
+      std::size_t firstVariable,
+      double buildTime) const
+  {
+    // Other jobs never see a partial schedule. If the file cannot be moved
+    // into place another job has just written the same schedule.
+    writeFileAtomically(fileName, [&] (std::ostream& os) {
+        os << scheduleFileHeader << '\n'
+           << std::hex << hash << std::dec << '\n'
+           << std::setprecision(17) << buildTime << '\n'
+           << std::setprecision(9);
+        os << m_usedVars.size() - firstVariable << '\n';
+        for (std::size_t idx = firstVariable; idx < m_usedVars.size(); ++idx) {
+          writeString(os, m_usedVars.at(idx) );
+          os << '\n';
+        }
+        // Write the nodes in pre-order, each with its depth
+        std::vector<std::pair<const ScheduleNode*, std::size_t>> stack;
+        for (std::size_t idx = m_schedule.children.size(); idx > firstChild; --idx)
+          stack.emplace_back(&m_schedule.children.at(idx-1), 1);
+        while (!stack.empty() ) {
+          const ScheduleNode* node = stack.back().first;
+          std::size_t depth = stack.back().second;
+          stack.pop_back();
+          os << depth << ' ' << static_cast<int>(node->action.type) << ' '
+             << node->action.cost << ' ';
+          writeString(os, node->action.name);
+          os << ' ';
+          writeString(os, node->region);
+          os << '\n';
+          for (auto itr = node->children.rbegin(); itr != node->children.rend(); ++itr)
+            stack.emplace_back(&*itr, depth + 1);
+        }
+      });
+  }
+
+  bool SchedulerBase::readSchedule(
+      const std::string& fileName,
+      std::uint64_t hash,
+      double& buildTime)
+  {
+    std::ifstream is(fileName);
+    if (!is)
+      return false;
+    std::string header;
+    std::getline(is, header);
+    std::uint64_t fileHash;
+    if (header != scheduleFileHeader ||
+        !(is >> std::hex >> fileHash >> std::dec) ||
+        fileHash != hash ||
+        !(is >> buildTime) )
+      return false;
+    std::size_t nVars;
+    if (!(is >> nVars) )
+      return false;
+    std::vector<std::string> usedVars(nVars);
+    for (std::string& var : usedVars)
+      if (!readString(is, var) )
+        return false;
+    // Rebuild the tree, keeping track of the current node at each depth
+    ScheduleNode root({FILTER, "ROOT"});
+    std::vector<ScheduleNode*> parents{&root};
+    std::size_t depth;
+    while (is >> depth) {
+      int type;
+      float cost;
+      std::string name;
+      std::string region;
+      if (depth == 0 || depth > parents.size() ||
+          !(is >> type >> cost) || is.get() != ' ' ||
+          !readString(is, name) || is.get() != ' ' ||
+          !readString(is, region) ||
+          type < FILTER || type >= INVALID)
+        return false;
+      parents.resize(depth);
+      parents.back()->children.emplace_back(
+          Action(static_cast<ActionType>(type), name, cost) );
+      parents.back()->children.back().region = std::move(region);
+      parents.push_back(&parents.back()->children.back() );
+    }
+    if (!is.eof() )
+      return false;
+    std::move(root.children.begin(), root.children.end(),
+        std::back_inserter(m_schedule.children) );
+    std::move(usedVars.begin(), usedVars.end(),
+        std::back_inserter(m_usedVars) );
+    return true;
+  }
+
+  void SchedulerBase::buildSchedule(
+      const IBranchNamer& namer,
+      ScheduleNode&& rawRoot,
+      ScheduleNode& target)
+  {
+    // Intern all of the actions. This also resolves the 'satisfaction
+    // relations'. i.e. if A satisfies B and B satisfies C then A should satisfy
+    // C. This is only necessary for filters
+    buildActionTable();
+    // What pre-existing dependencies are there (i.e. variables in the input
+    // namer). Anything not in the action table can't be asked for.
+    boost::dynamic_bitset<> preExisting(m_actionTable.size() );
+    for (const std::string& branch : namer.branches() ) {
+      ActionID_t id = findAction({VARIABLE, branch});
+      if (id != noAction)
+        preExisting.set(id);
+    }
+    boost::dynamic_bitset<> usedVars(m_actionTable.size() );
+    for (const std::string& var : m_usedVars) {
+      ActionID_t id = findAction({VARIABLE, var});
+      if (id != noAction)
+        usedVars.set(id);
+    }
+    // This thread counts as one of the workers
+    std::atomic<std::size_t> freeWorkers(
+        m_schedulingThreads > 1 ? m_schedulingThreads - 1 : 0);
+    SchedulingState state(usedVars, &freeWorkers);
 
     // Expand all of the children of the raw root node
-    for (ScheduleNode& child : rawRoot.children)
-      child.expand(*this, preExisting);
-    addChildren(std::move(rawRoot.children), &m_schedule, preExisting);
-    return m_schedule;
+    std::vector<PendingNode> children;
+    children.reserve(rawRoot.children.size() );
+    ExpansionCache& cache = expansionCache(state.caches, preExisting);
+    for (ScheduleNode& child : rawRoot.children) {
+      children.push_back(internNode(std::move(child) ) );
+      std::vector<ActionID_t> processing;
+      children.back().dependencies = expand(
+          children.back().action, cache, processing);
+    }
+    addChildren(std::move(children), &target, preExisting, state);
+    for (ActionID_t id : state.newVars)
+      m_usedVars.push_back(m_actionTable.at(id).name);
+  }
+
+  SchedulerBase::ScheduleUpdate SchedulerBase::updateSchedule(
+      const IBranchNamer& namer)
+  {
+    // Find everything that hasn't been scheduled yet. For regions that have
+    // already been scheduled this is just any new fills
+    std::map<std::string, RegionDef> newRegions;
+    std::map<std::string, RegionDef> pending;
+    for (const auto& regionPair : m_regionDefs) {
+      auto itr = m_scheduledRegions.find(regionPair.first);
+      if (itr == m_scheduledRegions.end() ) {
+        newRegions.insert(regionPair);
+        continue;
+      }
+      // Keep the filter order that the region was scheduled with
+      RegionDef newFills;
+      for (const std::string& fill : regionPair.second.fills)
+        if (!itr->second.fills.count(fill) )
+          newFills.addFill(fill);
+      if (!newFills.fills.empty() ) {
+        newFills.filterList = itr->second.filterList;
+        pending[regionPair.first] = std::move(newFills);
+      }
+    }
+    if (!newRegions.empty() ) {
+      // A new region with the same filters as a scheduled one has to keep its
+      // order, otherwise the two could become identical
+      std::set<std::set<std::string>> scheduledFilters;
+      for (const auto& regionPair : m_scheduledRegions)
+        scheduledFilters.insert({
+            regionPair.second.filterList.begin(),
+            regionPair.second.filterList.end()});
+      std::map<std::string, RegionDef> reorderable;
+      for (const auto& regionPair : newRegions) {
+        if (scheduledFilters.count({
+              regionPair.second.filterList.begin(),
+              regionPair.second.filterList.end()}) )
+          pending.insert(regionPair);
+        else
+          reorderable.insert(regionPair);
+      }
+      std::map<std::string, RegionDef> ordered = regionsToSchedule(reorderable);
+      pending.insert(ordered.begin(), ordered.end() );
+    }
+    ScheduleUpdate update;
+    if (pending.empty() )
+      return update;
+    // Schedule these on their own
+    std::size_t firstVariable = m_usedVars.size();
+    ScheduleNode newRoot({FILTER, "ROOT"});
+    buildSchedule(namer, rawSchedule(pending), newRoot);
+    update.newVariables.assign(
+        m_usedVars.begin() + firstVariable, m_usedVars.end() );
+    // Then splice them into the existing schedule
+    std::vector<std::size_t> path;
+    mergeSchedule(std::move(newRoot), m_schedule, path, update);
+    for (const auto& regionPair : pending) {
+      RegionDef& scheduled = m_scheduledRegions[regionPair.first];
+      scheduled.filterList = regionPair.second.filterList;
+      scheduled.fills.insert(
+          regionPair.second.fills.begin(), regionPair.second.fills.end() );
+    }
+    return update;
+  }
+
+  void SchedulerBase::mergeSchedule(
+      ScheduleNode&& source,
+      ScheduleNode& target,
+      std::vector<std::size_t>& path,
+      ScheduleUpdate& update)
+  {
+    for (ScheduleNode& child : source.children) {
+      auto itr = std::find_if(
+          target.children.begin(),
+          target.children.end(),
+          [&child] (const ScheduleNode& node) { return node.action == child.action; });
+      if (itr == target.children.end() ) {
+        // This is a new part of the schedule
+        target.children.push_back(std::move(child) );
+        path.push_back(target.children.size() - 1);
+        update.newNodes.push_back(path);
+        path.pop_back();
+        continue;
+      }
+      path.push_back(itr - target.children.begin() );
+      if (!child.region.empty() ) {
+        if (itr->region.empty() ) {
+          itr->region = child.region;
+          update.newRegions.push_back(path);
+        }
+        else if (itr->region != child.region)
+          throw std::runtime_error("Region definitions for '"+
+              itr->region + "' and '" + child.region +
+              "' are identical after dependency resolution!");
+      }
+      mergeSchedule(std::move(child), *itr, path, update);
+      path.pop_back();
+    }
+  }
+
+  SchedulerBase::PendingNode SchedulerBase::internNode(
+      ScheduleNode&& node) const
+  {
+    PendingNode pending(m_actionIDs.at(node.action) );
+    pending.region = std::move(node.region);
+    pending.children.reserve(node.children.size() );
+    for (ScheduleNode& child : node.children)
+      pending.children.push_back(internNode(std::move(child) ) );
+    return pending;
+  }
+
+  std::map<std::string, SchedulerBase::RegionDef> SchedulerBase::regionsToSchedule(
+      const std::map<std::string, RegionDef>& regionDefs) const
+  {
+    // Drop any threshold filters that are implied by an earlier filter in the
+    // same region. These would otherwise be reported as already satisfied.
+    std::map<std::string, RegionDef> pruned = regionDefs;
+    for (auto& regionPair : pruned) {
+      std::vector<std::string>& filterList = regionPair.second.filterList;
+      std::vector<std::string> kept;
+      for (const std::string& filter : filterList) {
+        auto itr = m_thresholdFilters.find(filter);
+        bool implied = itr != m_thresholdFilters.end() && !itr->second.weighted &&
+          std::any_of(kept.begin(), kept.end(),
+              [this, itr] (const std::string& previous) {
+                auto prevItr = m_thresholdFilters.find(previous);
+                return prevItr != m_thresholdFilters.end() &&
+                  prevItr->second.implies(itr->second) &&
+                  !itr->second.implies(prevItr->second);
+              });
+        if (!implied)
+          kept.push_back(filter);
+      }
+      filterList = std::move(kept);
+    }
+    if (!m_optimizeFilterOrder)
+      return pruned;
+    std::map<std::string, RegionDef> optimized = optimizedRegionDefs(pruned);
+    std::cout << "Optimised the region filter order, estimated filter "
+              << "evaluations per entry " << estimatedFilterEvaluations(pruned)
+              << " before and " << estimatedFilterEvaluations(optimized)
+              << " after." << std::endl;
+    return optimized;
   }
 
   SchedulerBase::ScheduleNode SchedulerBase::rawSchedule() const
+  {
+    return rawSchedule(m_regionDefs);
+  }
+
+  SchedulerBase::ScheduleNode SchedulerBase::rawSchedule(
+      const std::map<std::string, RegionDef>& regionDefs) const
   {
     // First step is to take our lists of filter steps and convert them into a
     // tree-like structure
@@ -397,7 +1645,7 @@ namespace RDFAnalysis {
     //      |
     //      E -- F
     ScheduleNode root({FILTER, "ROOT"});
-    for (const auto& regionPair : m_regionDefs) {
+    for (const auto& regionPair : regionDefs) {
       // Start each region def from the root
       ScheduleNode* current = &root;
       for (auto filterItr = regionPair.second.filterList.begin();
@@ -439,24 +1687,28 @@ namespace RDFAnalysis {
   } //> end function SchedulerBase::rawSchedule
 
   void SchedulerBase::addChildren(
-      std::vector<ScheduleNode>&& sources,
+      std::vector<PendingNode>&& sources,
       ScheduleNode* target,
-      std::set<Action> preExisting)
+      boost::dynamic_bitset<> preExisting,
+      SchedulingState& state) const
   {
     // End early if there's nothing to do
     if (sources.empty() )
       return;
     // If any of the sources actions are in the preExisting set then this is an
     // inconsistent set up (the filter order won't be what the user wanted).
-    for (const ScheduleNode& source : sources) {
-      Action satisfiedBy(INVALID, "");
-      if (source.action.type == FILTER &&
-          isActionSatisfiedBy(source.action, preExisting, satisfiedBy) ) {
-        std::string err = "Filter '" + source.action.name;
+    for (const PendingNode& source : sources) {
+      const Action& action = m_actionTable.at(source.action);
+      if (action.type != FILTER)
+        continue;
+      ActionID_t satisfiedBy = firstSatisfiedBy(source.action, preExisting);
+      if (satisfiedBy != noAction) {
+        std::string err = "Filter '" + action.name;
         if (satisfiedBy == source.action)
           err += "' already exists in the schedule!";
         else
-          err += "' was already satisfied by '" + satisfiedBy.name + "'!";
+          err += "' was already satisfied by '" +
+            m_actionTable.at(satisfiedBy).name + "'!";
         err += " This was probably added as a dependency.";
         throw std::runtime_error(err);
       }
@@ -469,15 +1721,13 @@ namespace RDFAnalysis {
       // if any of the sources are trying to add a variable then add it to the
       // internal lists of variables
       for (; itr != sources.end(); ++itr) {
-        Action toAdd = itr->next();
-        if (toAdd.type == VARIABLE) {
-          if (std::find(m_usedVars.begin(),
-                        m_usedVars.end(),
-                        toAdd.name) == m_usedVars.end() ) {
-            m_usedVars.push_back(toAdd.name);
-            preExisting.insert(toAdd);
+        ActionID_t toAdd = itr->next(*this);
+        if (m_actionTable.at(toAdd).type == VARIABLE) {
+          if (!state.usedVars.test(toAdd) ) {
+            state.useVariable(toAdd);
+            preExisting.set(toAdd);
           }
-          for (ScheduleNode& source : sources) {
+          for (PendingNode& source : sources) {
             source.removeDependency(toAdd, *this);
           }
           break;
@@ -490,43 +1740,140 @@ namespace RDFAnalysis {
     // When we've reached this point it's guaranteed that every source is trying
     // to add a filter/fill next.
     // The next step is to group them by the action they're trying to add
-    std::map<Action, std::vector<ScheduleNode>> grouped;
-    for (ScheduleNode& node : sources)
-      grouped[node.next()].push_back(std::move(node) );
+    std::map<ActionID_t, std::vector<PendingNode>> grouped;
+    for (PendingNode& node : sources)
+      grouped[node.next(*this)].push_back(std::move(node) );
+
+    // Each group becomes a new child of the current node, below which the
+    // schedule is built independently of the other groups. Create all of the
+    // children first so that pointers to them stay valid.
+    struct ChildTask {
+      /// The new child node
+      ScheduleNode* target;
+      /// The sources that still need to be added below it
+      std::vector<PendingNode> sources;
+      /// The sources that need to be expanded before they are added
+      std::vector<PendingNode> nextChildren;
+      /// The actions that exist at the new child node
+      boost::dynamic_bitset<> preExisting;
+      /// Any error found while preparing the task
+      std::exception_ptr error;
+    }; //> end struct ChildTask
+    std::vector<ChildTask> tasks;
+    tasks.reserve(grouped.size() );
+    current->children.reserve(current->children.size() + grouped.size() );
     for (auto& groupedPair : grouped) {
-      // Add the action to the output
-      current->children.emplace_back(groupedPair.first);
-      std::vector<ScheduleNode> nextChildren;
-      auto itr = groupedPair.second.begin();
-      while (itr != groupedPair.second.end() ) {
-        // Remove the filter from our dependencies
-        itr->removeDependency(groupedPair.first, *this);
-        if (itr->dependencies.empty() ) {
-          if (!itr->region.empty() ) {
-            if (current->children.back().region.empty() )
-              current->children.back().region = itr->region;
-            else
-              throw std::runtime_error("Region definitions for '"+
-                  current->children.back().region + "' and '" + itr->region +
-                  "' are identical after dependency resolution!");
+      // Add the action to the output. This is the only point at which the
+      // names are needed again.
+      current->children.emplace_back(m_actionTable.at(groupedPair.first) );
+      tasks.push_back({&current->children.back(), {}, {}, preExisting, nullptr});
+      ChildTask& task = tasks.back();
+      task.preExisting.set(groupedPair.first);
+      // Errors are only reported once every earlier group has been built so
+      // that the same error is reported as when building serially
+      try {
+        auto itr = groupedPair.second.begin();
+        while (itr != groupedPair.second.end() ) {
+          // Remove the filter from our dependencies
+          itr->removeDependency(groupedPair.first, *this);
+          if (itr->dependencies.empty() ) {
+            if (!itr->region.empty() ) {
+              if (task.target->region.empty() )
+                task.target->region = itr->region;
+              else
+                throw std::runtime_error("Region definitions for '"+
+                    task.target->region + "' and '" + itr->region +
+                    "' are identical after dependency resolution!");
+            }
+            // We've done everything we need to for this source
+            std::move(itr->children.begin(), itr->children.end(),
+                std::back_inserter(task.nextChildren) );
+            itr = groupedPair.second.erase(itr);
           }
-          // We've done everything we need to for this source
-          std::move(itr->children.begin(), itr->children.end(),
-              std::back_inserter(nextChildren) );
-          itr = groupedPair.second.erase(itr);
+          else
+            ++itr;
         }
-        else
-          ++itr;
       }
-      std::set<Action> preExistingNext = preExisting;
-      preExistingNext.insert(groupedPair.first);
-      for (ScheduleNode& child : nextChildren)
-        child.expand(*this, preExistingNext);
-      std::move(nextChildren.begin(), nextChildren.end(),
-          std::back_inserter(groupedPair.second) );
-      addChildren(std::move(groupedPair.second),
-                  &current->children.back(),
-                  preExistingNext);
+      catch (...) {
+        task.error = std::current_exception();
+      }
+      task.sources = std::move(groupedPair.second);
+    }
+
+    auto build = [this] (ChildTask& task, SchedulingState& state) {
+      if (task.error)
+        std::rethrow_exception(task.error);
+      // All of these children share the same pre-existing actions so they can
+      // share their expansions
+      ExpansionCache& cache = expansionCache(state.caches, task.preExisting);
+      for (PendingNode& child : task.nextChildren) {
+        std::vector<ActionID_t> processing;
+        child.dependencies = expand(child.action, cache, processing);
+      }
+      std::move(task.nextChildren.begin(), task.nextChildren.end(),
+          std::back_inserter(task.sources) );
+      addChildren(std::move(task.sources),
+                  task.target,
+                  std::move(task.preExisting),
+                  state);
+    };
+
+    // Where threads are available build the later groups speculatively. Each
+    // speculative build starts from the variables used before any group is
+    // built. This is only correct if none of the variables it uses for the
+    // first time were used by an earlier group, in which case it is rebuilt.
+    struct Speculation {
+      Speculation(const ChildTask& task, const SchedulingState& state) :
+        backup(task), state(state.usedVars, state.freeWorkers) {}
+      /// Copy of the task, in case it has to be rebuilt
+      ChildTask backup;
+      /// The state used by the speculative build
+      SchedulingState state;
+      /// Any error from the speculative build
+      std::exception_ptr error;
+      /// The result of the build
+      std::future<void> result;
+    }; //> end struct Speculation
+    std::vector<std::unique_ptr<Speculation>> speculations(tasks.size() );
+    for (std::size_t idx = 1; idx < tasks.size(); ++idx) {
+      if (tasks.at(idx).error || !state.acquireWorker() )
+        continue;
+      auto speculation = std::make_unique<Speculation>(tasks.at(idx), state);
+      Speculation* spec = speculation.get();
+      ChildTask* task = &tasks.at(idx);
+      spec->result = std::async(std::launch::async, [spec, task, build] () {
+          try {
+            build(*task, spec->state);
+          }
+          catch (...) {
+            spec->error = std::current_exception();
+          }
+          spec->state.releaseWorker();
+        });
+      speculations.at(idx) = std::move(speculation);
+    }
+
+    // Now merge the groups in order
+    for (std::size_t idx = 0; idx < tasks.size(); ++idx) {
+      Speculation* spec = speculations.at(idx).get();
+      if (!spec) {
+        build(tasks.at(idx), state);
+        continue;
+      }
+      spec->result.wait();
+      bool valid = std::none_of(
+          spec->state.newVars.begin(), spec->state.newVars.end(),
+          [&state] (ActionID_t id) { return state.usedVars.test(id); });
+      if (valid) {
+        for (ActionID_t id : spec->state.newVars)
+          state.useVariable(id);
+        if (spec->error)
+          std::rethrow_exception(spec->error);
+      }
+      else {
+        tasks.at(idx).target->children.clear();
+        build(spec->backup, state);
+      }
     }
   }
 
@@ -540,27 +1887,4 @@ namespace RDFAnalysis {
     boost::write_graphviz(os, graph, ActionWriter(propMap) );
   }
 
-  void SchedulerBase::expandSatisfiesRelations(
-      std::map<Action, std::set<Action>>::iterator currentItr,
-      std::set<Action>& processed)
-  {
-    if (currentItr == m_satisfiedBy.end() )
-      return;
-    if (!processed.count(currentItr->first) && currentItr->first.type == FILTER) {
-      processed.insert(currentItr->first);
-      // Make a copy of the original set so we can modify the real one.
-      std::set<Action> toExpand = currentItr->second;
-      for (const Action& action : toExpand) {
-        auto nextItr = m_satisfiedBy.find(action);
-        if (nextItr != m_satisfiedBy.end() ) {
-          // Expand *that* action
-          expandSatisfiesRelations(nextItr, processed);
-          // Then add everything that satisfies that action to the list of
-          // everything that affects us
-          currentItr->second.insert(nextItr->second.begin(), nextItr->second.end() );
-        }
-      }
-    }
-    return expandSatisfiesRelations(++currentItr, processed);
-  }
 } //> end namespace RDFAnalysis
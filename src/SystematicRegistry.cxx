@@ -0,0 +1,88 @@
+#include "RDFAnalysis/SystematicRegistry.h"
+#include <stdexcept>
+
+namespace RDFAnalysis {
+  constexpr SysID_t SystematicRegistry::nominalID;
+  constexpr SysID_t SystematicRegistry::npos;
+
+  SystematicRegistry::SystematicRegistry(const std::string& nominalName)
+  {
+    intern(nominalName);
+  }
+
+  SysID_t SystematicRegistry::intern(const std::string& name)
+  {
+    auto itr = m_ids.find(name);
+    if (itr != m_ids.end() )
+      return itr->second;
+    if (m_names.size() == RDFAnalysis_MAX_SYSTEMATICS)
+      throw std::length_error(
+          "Cannot register systematic " + name + ", the maximum of " +
+          std::to_string(RDFAnalysis_MAX_SYSTEMATICS) + " has been reached!");
+    SysID_t newID = m_names.size();
+    m_names.push_back(name);
+    m_ids.emplace(name, newID);
+    return newID;
+  }
+
+  SysID_t SystematicRegistry::id(const std::string& name) const
+  {
+    SysID_t found = find(name);
+    if (found == npos)
+      throw std::out_of_range("Unknown variation " + name);
+    return found;
+  }
+
+  SysID_t SystematicRegistry::find(const std::string& name) const
+  {
+    if (name.empty() )
+      return nominalID;
+    auto itr = m_ids.find(name);
+    return itr == m_ids.end() ? npos : itr->second;
+  }
+
+  SystematicMask SystematicRegistry::mask(
+      const std::set<std::string>& names) const
+  {
+    SystematicMask result;
+    for (const std::string& name : names)
+      result.set(id(name) );
+    return result;
+  }
+
+  std::set<std::string> SystematicRegistry::names(
+      const SystematicMask& mask) const
+  {
+    std::set<std::string> result;
+    for (SysID_t syst = 0; syst < size(); ++syst)
+      if (mask.test(syst) )
+        result.insert(m_names[syst]);
+    return result;
+  }
+
+  const SystematicGroup& SystematicRegistry::declareGroup(
+      const std::string& name,
+      const std::set<std::string>& members)
+  {
+    SystematicMask grouped;
+    for (const SystematicGroup& group : m_groups) {
+      if (group.name == name)
+        throw std::invalid_argument("Group " + name + " is already declared");
+      grouped |= group.members;
+    }
+    SystematicGroup group;
+    group.name = name;
+    group.members = mask(members);
+    if (group.members.test(nominalID) )
+      throw std::invalid_argument(
+          "The nominal cannot be part of group " + name);
+    if ( (group.members & grouped).any() )
+      throw std::invalid_argument(
+          "Some members of group " + name + " are already in another group");
+    std::size_t idx = 0;
+    for (const char* suffix : {"__min", "__max", "__sum", "__sumsq"})
+      group.summaries.at(idx++) = intern(name + suffix);
+    m_groups.push_back(group);
+    return m_groups.back();
+  }
+} //> end namespace RDFAnalysis
@@ -0,0 +1,215 @@
+/**
+ * @file ExpressionEvaluator.cxx
+ * @brief Check that expressions evaluated without the interpreter give the
+ * same results as the interpreter.
+ *
+ * Each expression is defined (or filtered on) both through defineEvaluated
+ * (or filterEvaluated) and as a string expression compiled by cling on a small
+ * in-memory RDataFrame. The column types and the values of every entry must
+ * match. Expressions whose result would be an int must be rejected, as the
+ * interpreter would make an int column.
+ */
+
+#include "RDFAnalysis/ExpressionEvaluator.h"
+#include "RDFAnalysis/PackColumns.h"
+
+#include <ROOT/RDataFrame.hxx>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+  using RNode = ROOT::RDF::RNode;
+
+  /// An expression template and the columns substituted into it
+  struct Case {
+    /// The expression template
+    std::string expression;
+    /// The columns
+    std::vector<std::string> columns;
+    /// The largest allowed relative difference, for the functions that the
+    /// interpreter may call with a different precision
+    double tolerance = 0;
+  };
+
+  /// Substitute the columns into an expression template
+  std::string expand(const Case& test)
+  {
+    std::string expression = test.expression;
+    for (std::size_t idx = 0; idx < test.columns.size(); ++idx) {
+      std::string placeholder = "{" + std::to_string(idx) + "}";
+      for (std::size_t pos = expression.find(placeholder); pos != std::string::npos;
+          pos = expression.find(placeholder, pos) )
+        expression.replace(pos, placeholder.size(), test.columns.at(idx) );
+    }
+    return expression;
+  }
+
+  /// Book reading a column of a known type, returning a function that gives
+  /// its values once the event loop has run
+  std::function<std::vector<double>()> bookValues(
+      RNode& rnode,
+      const std::string& column)
+  {
+    std::string type = RDFAnalysis::detail::normalizeColumnType(
+        rnode.GetColumnType(column) );
+    std::function<std::vector<double>()> values;
+    bool known = RDFAnalysis::detail::visitScalarType(type,
+        [&] (auto tag) {
+          auto result = rnode.Take<typename decltype(tag)::type>(column);
+          values = [result] () mutable {
+            return std::vector<double>(result->begin(), result->end() ); };
+        });
+    if (!known)
+      throw std::runtime_error("Unexpected type " + type + " for " + column);
+    return values;
+  }
+
+  /// Whether two values match, to within a relative tolerance
+  bool matches(double lhs, double rhs, double tolerance)
+  {
+    if (std::isnan(lhs) || std::isnan(rhs) )
+      return std::isnan(lhs) && std::isnan(rhs);
+    if (lhs == rhs)
+      return true;
+    return std::abs(lhs - rhs) <= tolerance * std::max(std::abs(lhs), std::abs(rhs) );
+  }
+
+  /// Compare a Define made by the evaluator to the interpreter's
+  bool checkDefine(RNode& input, const Case& test)
+  {
+    std::string expression = expand(test);
+    RNode evaluated = input;
+    if (!RDFAnalysis::detail::defineEvaluated(
+          input, evaluated, "evaluated", test.expression, test.columns) ) {
+      std::cout << "FAIL: '" << expression << "' is not evaluated" << std::endl;
+      return false;
+    }
+    RNode rnode = evaluated.Define("interpreted", expression);
+    std::string type = rnode.GetColumnType("evaluated");
+    std::string expected = rnode.GetColumnType("interpreted");
+    if (RDFAnalysis::detail::normalizeColumnType(type) !=
+        RDFAnalysis::detail::normalizeColumnType(expected) ) {
+      std::cout << "FAIL: '" << expression << "' has type " << type
+                << " instead of " << expected << std::endl;
+      return false;
+    }
+    auto evaluatedValues = bookValues(rnode, "evaluated");
+    auto interpretedValues = bookValues(rnode, "interpreted");
+    std::vector<double> lhs = evaluatedValues();
+    std::vector<double> rhs = interpretedValues();
+    for (std::size_t idx = 0; idx < lhs.size(); ++idx) {
+      if (!matches(lhs.at(idx), rhs.at(idx), test.tolerance) ) {
+        std::cout << "FAIL: '" << expression << "' gives " << lhs.at(idx)
+                  << " instead of " << rhs.at(idx) << " for entry " << idx
+                  << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Compare a Filter made by the evaluator to the interpreter's
+  bool checkFilter(RNode& input, const Case& test)
+  {
+    std::string expression = expand(test);
+    RNode evaluated = input;
+    if (!RDFAnalysis::detail::filterEvaluated(
+          input, evaluated, test.expression, test.columns, "evaluated") ) {
+      std::cout << "FAIL: '" << expression << "' is not evaluated" << std::endl;
+      return false;
+    }
+    // Each entry should pass both filters or neither
+    auto both = evaluated.Filter(expression).Count();
+    auto either = input.Filter(expression).Count();
+    auto passed = evaluated.Count();
+    if (*both != *either || *both != *passed) {
+      std::cout << "FAIL: '" << expression << "' passes " << *passed
+                << " entries instead of " << *either << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  /// Check that an expression is left for the interpreter
+  bool checkRejected(RNode& input, const Case& test)
+  {
+    RNode evaluated = input;
+    if (RDFAnalysis::detail::canEvaluate(input, test.expression, test.columns, false) ||
+        RDFAnalysis::detail::defineEvaluated(
+          input, evaluated, "evaluated", test.expression, test.columns) ) {
+      std::cout << "FAIL: '" << expand(test) << "' should not be evaluated"
+                << std::endl;
+      return false;
+    }
+    return true;
+  }
+} //> end anonymous namespace
+
+int main()
+{
+  RNode input = ROOT::RDataFrame(50)
+    .Define("f", [] (ULong64_t entry) { return (static_cast<float>(entry) - 25) * 0.37f; }, {"rdfentry_"})
+    .Define("d", [] (ULong64_t entry) { return (static_cast<double>(entry) - 25) * 0.37; }, {"rdfentry_"})
+    .Define("i", [] (ULong64_t entry) { return static_cast<int>(entry) - 25; }, {"rdfentry_"})
+    .Define("j", [] (ULong64_t entry) { return static_cast<int>(entry % 4) + 1; }, {"rdfentry_"})
+    .Define("b", [] (ULong64_t entry) { return entry % 3 == 0; }, {"rdfentry_"});
+
+  std::vector<Case> defines{
+    // Float arithmetic is rounded to float after every operation
+    {"{0} * {1} + {2}", {"f", "f", "f"}},
+    {"{0} * 0.1f + 1", {"f"}},
+    {"{0} / 3", {"f"}},
+    // Double constants and columns promote to double
+    {"{0} * 0.1 + 1", {"f"}},
+    {"{0} + {1}", {"f", "d"}},
+    // Integer division and remainder truncate towards zero
+    {"{0} / {1} * 1.0", {"i", "j"}},
+    {"{0} % {1} * 1.0", {"i", "j"}},
+    {"{0} / {1} * 1.0f", {"i", "j"}},
+    {"({0} - 1) / 4 + {1}", {"i", "d"}},
+    // Result types of pow and abs
+    {"std::pow({0}, {1})", {"f", "f"}},
+    {"std::pow({0}, 2)", {"f"}},
+    {"pow({0}, 0.5)", {"d"}},
+    {"std::abs({0})", {"f"}},
+    {"abs({0})", {"d"}},
+    {"std::abs({0}) * 0.5", {"i"}},
+    {"fabs({0})", {"f"}},
+    {"sqrt(abs({0}))", {"f"}},
+    {"exp({0} / 10)", {"f"}, 1e-6},
+    {"log(abs({0}) + 1)", {"d"}, 1e-12},
+    // Bool results
+    {"{0} > 1 && !{1}", {"f", "b"}},
+    {"{0} % {1} == 0 || {2} < -3", {"i", "j", "d"}}
+  };
+  std::vector<Case> filters{
+    {"{0} % {1} == 1", {"i", "j"}},
+    {"{0} / {1} == -2", {"i", "j"}},
+    {"std::abs({0}) < 5.5f", {"f"}},
+    {"{0} * 0.1f > {1} * 0.1", {"f", "d"}}
+  };
+  // The interpreter would make int columns from these
+  std::vector<Case> rejected{
+    {"{0} / {1}", {"i", "j"}},
+    {"{0} % 3", {"i"}},
+    {"abs({0})", {"i"}},
+    {"{0} + 1", {"b"}}
+  };
+
+  std::size_t failures = 0;
+  for (const Case& test : defines)
+    failures += !checkDefine(input, test);
+  for (const Case& test : filters)
+    failures += !checkFilter(input, test);
+  for (const Case& test : rejected)
+    failures += !checkRejected(input, test);
+  std::size_t total = defines.size() + filters.size() + rejected.size();
+  std::cout << total - failures << " of " << total << " checks passed" << std::endl;
+  return failures == 0 ? 0 : 1;
+}
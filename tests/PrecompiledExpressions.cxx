@@ -0,0 +1,69 @@
+/**
+ * @file PrecompiledExpressions.cxx
+ * @brief Check that expressions written by writeCompiledExpressions are used
+ * without being compiled again.
+ *
+ * The same source builds two programs. Given a file name it books a few
+ * string expressions that the interpreter has to compile, checks them and
+ * writes them to that file with writeCompiledExpressions. Built together with
+ * that file and run without arguments it books the same expressions, which
+ * must give the same results without a single batch being compiled.
+ *
+ * Usage: testPrecompiledExpressions [output file]
+ */
+
+#include "RDFAnalysis/CompiledExpression.h"
+
+#include <ROOT/RDataFrame.hxx>
+
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+  using ROOT::VecOps::RVec;
+  ROOT::RDF::RNode input = ROOT::RDataFrame(100)
+    .Define("x", [] (ULong64_t entry) { return RVec<float>(entry % 5, entry * 0.5f); }, {"rdfentry_"})
+    .Define("y", [] (ULong64_t entry) { return 12.5f - entry * 0.25f; }, {"rdfentry_"});
+
+  // None of these can be evaluated without the interpreter, and the last
+  // define uses a column that is not one of its inputs
+  ROOT::RDF::RNode compiled = input;
+  compiled = RDFAnalysis::detail::filterCompiled(compiled, "{0}.size() > 2", {"x"}, "nx");
+  compiled = RDFAnalysis::detail::defineCompiled(compiled, "total", "ROOT::VecOps::Sum({0})", {"x"});
+  compiled = RDFAnalysis::detail::defineCompiled(compiled, "magnitude", "{0} > 0 ? {0} : -{0}", {"y"});
+  compiled = RDFAnalysis::detail::defineCompiled(compiled, "scaled", "y * 2 + {0}.size()", {"x"});
+  auto total = compiled.Sum<float>("total");
+  auto magnitude = compiled.Sum<float>("magnitude");
+  auto scaled = compiled.Sum<float>("scaled");
+
+  ROOT::RDF::RNode expected = input
+    .Filter([] (const RVec<float>& x) { return x.size() > 2; }, {"x"})
+    .Define("total", [] (const RVec<float>& x) { return ROOT::VecOps::Sum(x); }, {"x"})
+    .Define("magnitude", [] (float y) { return y > 0 ? y : -y; }, {"y"})
+    .Define("scaled", [] (float y, const RVec<float>& x) { return y * 2 + x.size(); }, {"y", "x"});
+  auto expectedTotal = expected.Sum<float>("total");
+  auto expectedMagnitude = expected.Sum<float>("magnitude");
+  auto expectedScaled = expected.Sum<float>("scaled");
+
+  bool passed = true;
+  if (*total != *expectedTotal || *magnitude != *expectedMagnitude ||
+      *scaled != *expectedScaled) {
+    std::cout << "FAIL: the compiled expressions give " << *total << ", "
+              << *magnitude << " and " << *scaled << " instead of "
+              << *expectedTotal << ", " << *expectedMagnitude << " and "
+              << *expectedScaled << std::endl;
+    passed = false;
+  }
+
+  if (argc > 1) {
+    RDFAnalysis::writeCompiledExpressions(argv[1]);
+  }
+  else if (RDFAnalysis::detail::compiledBatchCount() != 0) {
+    std::cout << "FAIL: " << RDFAnalysis::detail::compiledBatchCount()
+              << " batches of expressions were compiled instead of being "
+              << "taken from the generated file" << std::endl;
+    passed = false;
+  }
+  return passed ? 0 : 1;
+}